@@ -9,13 +9,6 @@
 wf_option FireAnimation::fire_particles;
 wf_option FireAnimation::fire_particle_size;
 
-// generate a random float between s and e
-static float random(float s, float e)
-{
-    double r = 1.0 * (std::rand() % RAND_MAX) / (RAND_MAX - 1);
-    return (s * r + (1 - r) * e);
-}
-
 static int particle_count_for_width(int width)
 {
     int particles = FireAnimation::fire_particles->as_cached_int();
@@ -32,8 +25,7 @@ class FireTransformer : public wf_view_transformer_t
     ParticleSystem ps;
 
     FireTransformer(wayfire_view view) :
-        ps(FireAnimation::fire_particles->as_cached_int(),
-           [=] (Particle& p) {init_particle(p); })
+        ps(FireAnimation::fire_particles->as_cached_int())
     {
         last_boundingbox = view->get_bounding_box();
         ps.resize(particle_count_for_width(last_boundingbox.width));
@@ -69,25 +61,32 @@ class FireTransformer : public wf_view_transformer_t
     void set_progress_line(float line)
     {
         progress_line = line;
+        ps.set_emitter(get_emitter());
     }
 
-    void init_particle(Particle& p)
+    /* New particles start around the progress line */
+    ParticleEmitter get_emitter()
     {
-        p.life = 1;
-        p.fade = random(0.1, 0.6);
+        ParticleEmitter emitter;
+        emitter.fade_min = 0.1;
+        emitter.fade_max = 0.6;
 
-        p.color = {random(0.4, 1), random(0.08, 0.2), random(0.008, 0.018), 1};
+        emitter.color_min = {0.4, 0.08, 0.008, 1};
+        emitter.color_max = {1, 0.2, 0.018, 1};
 
-        p.pos = {random(0, last_boundingbox.width),
-            random(last_boundingbox.height * progress_line - 10,
-                   last_boundingbox.height * progress_line + 10)};
-        p.start_pos = p.pos;
+        emitter.pos_min = {0, last_boundingbox.height * progress_line - 10};
+        emitter.pos_max = {last_boundingbox.width,
+            last_boundingbox.height * progress_line + 10};
 
-        p.speed = {random(-10, 10), random(-25, 5)};
-        p.g = {-1, -3};
+        emitter.speed_min = {-10, -25};
+        emitter.speed_max = {10, 5};
+        emitter.g = {-1, -3};
 
         double size = FireAnimation::fire_particle_size->as_double();
-        p.base_radius = p.radius = random(size * 0.8, size * 1.2);
+        emitter.radius_min = size * 0.8;
+        emitter.radius_max = size * 1.2;
+
+        return emitter;
     }
 
     virtual void render_box(uint32_t src_tex, wlr_box src_box,
@@ -1,68 +1,168 @@
 #include "particle.hpp"
 #include "shaders.hpp"
 #include <core.hpp>
-#include <thread>
+#include <thread-pool.hpp>
 #include <debug.hpp>
-
-void Particle::update(float time)
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PARTICLE_SIMD 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define PARTICLE_SIMD 1
+#endif
+
+namespace
 {
-    if (life <= 0) // ignore
-        return;
-
-    const float slowdown = 0.8;
+const float slowdown = 0.8;
+const float speed_step = 0.2f * slowdown;
+const float g_step = 0.3f * slowdown;
+const float fade_step = 0.3f * slowdown;
+
+/* The quad of each particle */
+const float vertex_data[] = {
+    -1, -1,
+     1, -1,
+     1,  1,
+    -1,  1
+};
+
+// generate a random float between s and e
+float random(float s, float e)
+{
+    double r = 1.0 * (std::rand() % RAND_MAX) / (RAND_MAX - 1);
+    return (s * r + (1 - r) * e);
+}
 
-    pos += speed * 0.2f * slowdown;
-    speed += g * 0.3f * slowdown;
+#ifdef PARTICLE_SIMD
+/* The few operations the update kernel needs on 4 floats at once.
+ * Comparisons return a mask with all bits of the matching lanes set. */
+namespace simd
+{
+#if defined(__SSE2__)
+using vec_t = __m128;
+inline vec_t load(const float *p) { return _mm_loadu_ps(p); }
+inline void store(float *p, vec_t v) { _mm_storeu_ps(p, v); }
+inline vec_t splat(float v) { return _mm_set1_ps(v); }
+inline vec_t add(vec_t a, vec_t b) { return _mm_add_ps(a, b); }
+inline vec_t sub(vec_t a, vec_t b) { return _mm_sub_ps(a, b); }
+inline vec_t mul(vec_t a, vec_t b) { return _mm_mul_ps(a, b); }
+inline vec_t div(vec_t a, vec_t b) { return _mm_div_ps(a, b); }
+inline vec_t max(vec_t a, vec_t b) { return _mm_max_ps(a, b); }
+inline vec_t sqrt(vec_t a) { return _mm_sqrt_ps(a); }
+inline vec_t less(vec_t a, vec_t b) { return _mm_cmplt_ps(a, b); }
+inline vec_t select(vec_t mask, vec_t a, vec_t b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
 
-    if (life != 0)
-        color.a /= life;
+/* Bit i is set if lane i of the mask is set */
+inline int mask_bits(vec_t mask) { return _mm_movemask_ps(mask); }
+#else
+using vec_t = float32x4_t;
+inline vec_t load(const float *p) { return vld1q_f32(p); }
+inline void store(float *p, vec_t v) { vst1q_f32(p, v); }
+inline vec_t splat(float v) { return vdupq_n_f32(v); }
+inline vec_t add(vec_t a, vec_t b) { return vaddq_f32(a, b); }
+inline vec_t sub(vec_t a, vec_t b) { return vsubq_f32(a, b); }
+inline vec_t mul(vec_t a, vec_t b) { return vmulq_f32(a, b); }
+inline vec_t div(vec_t a, vec_t b) { return vdivq_f32(a, b); }
+inline vec_t max(vec_t a, vec_t b) { return vmaxq_f32(a, b); }
+inline vec_t sqrt(vec_t a) { return vsqrtq_f32(a); }
+inline vec_t less(vec_t a, vec_t b)
+{
+    return vreinterpretq_f32_u32(vcltq_f32(a, b));
+}
 
-    life -= fade * 0.3 * slowdown;
-    radius = base_radius * std::pow(life, 0.5);
-    color.a *= life;
+inline vec_t select(vec_t mask, vec_t a, vec_t b)
+{
+    return vbslq_f32(vreinterpretq_u32_f32(mask), a, b);
+}
 
-    if (start_pos.x < pos.x)
-        g.x = -1;
-    else
-        g.x = 1;
+inline int mask_bits(vec_t mask)
+{
+    uint32x4_t m = vreinterpretq_u32_f32(mask);
+    return (vgetq_lane_u32(m, 0) & 1) | (vgetq_lane_u32(m, 1) & 2) |
+        (vgetq_lane_u32(m, 2) & 4) | (vgetq_lane_u32(m, 3) & 8);
+}
+#endif
 
-    if (life <= 0)
-    {
-        /* move outside */
-        pos = {-10000, -10000};
-    }
+const int width = 4;
+}
+#endif
 }
 
-ParticleSystem::ParticleSystem(int particles, ParticleIniter init_func)
-{
-    this->pinit_func = init_func;
 
+ParticleSystem::ParticleSystem(int particles)
+{
+    create_program();
     resize(particles);
     last_update_msec = get_current_time();
-    create_program();
-
-    particles_alive.store(0);
 }
 
 ParticleSystem::~ParticleSystem()
 {
     OpenGL::render_begin();
-    GL_CALL(glDeleteProgram(program.id));
+    OpenGL::destroy_program(program.id);
+    buffer.release();
+
+    if (use_gpu)
+    {
+        GL_CALL(glDeleteProgram(update_program.id));
+        GL_CALL(glDeleteBuffers(2, state_buffer));
+        GL_CALL(glDeleteVertexArrays(2, state_vao));
+    }
+
     OpenGL::render_end();
 }
 
+void ParticleSystem::set_emitter(const ParticleEmitter& emitter)
+{
+    this->emitter = emitter;
+}
+
 int ParticleSystem::spawn(int num)
 {
-    // TODO: multithread this
+    if (!use_gpu)
+        return spawn_cpu(num);
+
+    num = std::max(0, std::min(num, particle_count - pending_spawns));
+    pending_spawns += num;
+    return num;
+}
+
+int ParticleSystem::spawn_cpu(int num)
+{
     int spawned = 0;
-    for (size_t i = 0; i < ps.size() && spawned < num; i++)
+    while (spawned < num && !free_list.empty())
     {
-        if (ps[i].life <= 0)
+        int i = free_list.back();
+        free_list.pop_back();
+
+        life[i] = 1;
+        fade[i] = random(emitter.fade_min, emitter.fade_max);
+        center_x[i] = random(emitter.pos_min.x, emitter.pos_max.x);
+        center_y[i] = random(emitter.pos_min.y, emitter.pos_max.y);
+        start_x[i] = center_x[i];
+        speed_x[i] = random(emitter.speed_min.x, emitter.speed_max.x);
+        speed_y[i] = random(emitter.speed_min.y, emitter.speed_max.y);
+        g_x[i] = emitter.g.x;
+        g_y[i] = emitter.g.y;
+        base_radius[i] = radius[i] =
+            random(emitter.radius_min, emitter.radius_max);
+
+        for (int j = 0; j < rgb_per_particle; j++)
         {
-            pinit_func(ps[i]);
-            ++spawned;
-            ++particles_alive;
+            rgb[rgb_per_particle * i + j] =
+                random(emitter.color_min[j], emitter.color_max[j]);
         }
+
+        alpha[i] = random(emitter.color_min.a, emitter.color_max.a);
+
+        ++spawned;
     }
 
     return spawned;
@@ -70,76 +170,131 @@ int ParticleSystem::spawn(int num)
 
 void ParticleSystem::resize(int num)
 {
-    if (num == (int)ps.size())
+    if (num == particle_count)
         return;
 
-    // TODO: multithread this
-    for (int i = num; i < (int)ps.size(); i++)
+    if (use_gpu)
+    {
+        resize_gpu(num);
+    } else
     {
-        if (ps[i].life >= 0)
-            --particles_alive;
+        resize_cpu(num);
     }
 
-    ps.resize(num);
+    particle_count = num;
+}
+
+void ParticleSystem::resize_cpu(int num)
+{
+    /* Forget the free particles which are removed */
+    auto it = std::remove_if(free_list.begin(), free_list.end(),
+        [=] (int i) { return i >= num; });
+    free_list.erase(it, free_list.end());
 
-    color.resize(color_per_particle * num);
-    dark_color.resize(color_per_particle * num);
-    radius.resize(radius_per_particle * num);
-    center.resize(center_per_particle * num);
+    /* New particles are dead, the ones with the lowest index are used first */
+    for (int i = num - 1; i >= particle_count; i--)
+        free_list.push_back(i);
+
+    for (auto array : {&fade, &base_radius, &center_x, &center_y, &speed_x,
+        &speed_y, &g_x, &g_y, &start_x, &alpha})
+    {
+        array->resize(num, 0);
+    }
+
+    life.resize(num, -1);
+    radius.resize(num, 0);
+    rgb.resize(rgb_per_particle * num, 0);
+
+    died.resize((num + particles_per_task - 1) / particles_per_task);
 }
 
 int ParticleSystem::size()
 {
-    return ps.size();
+    return particle_count;
 }
 
-void ParticleSystem::update_worker(float time, int start, int end)
+/* The scalar version of the update kernel, for the last particles of a range
+ * and for CPUs without SIMD */
+void ParticleSystem::update_particle(int i, std::vector<int>& dead)
 {
-    end = std::min(end, (int)ps.size());
-    for (int i = start; i < end; ++i)
-    {
-        if (ps[i].life <= 0)
-            continue;
+    if (life[i] <= 0)
+        return;
 
-    //    printf("%d\n", i);
-        ps[i].update(time);
+    center_x[i] += speed_x[i] * speed_step;
+    center_y[i] += speed_y[i] * speed_step;
+    speed_x[i] += g_x[i] * g_step;
+    speed_y[i] += g_y[i] * g_step;
 
-        if (ps[i].life <= 0)
-            --particles_alive;
+    float new_life = life[i] - fade[i] * fade_step;
+    alpha[i] = alpha[i] / life[i] * std::max(new_life, 0.0f);
+    radius[i] = base_radius[i] * std::sqrt(std::max(new_life, 0.0f));
+    life[i] = new_life;
 
-        for (int j = 0; j < 4; j++) // maybe use memcpy?
-        {
-            color[4 * i + j] = ps[i].color[j];
-            dark_color[4 * i + j] = ps[i].color[j] * 0.5;
-        }
+    g_x[i] = start_x[i] < center_x[i] ? -1 : 1;
 
-     //   printf("center %d gets %f", 2 * i, ps[i].pos[0]);
-        center[2 * i] = ps[i].pos[0];
-        center[2 * i + 1] = ps[i].pos[1];
-
-        radius[i] = ps[i].radius;
-    }
+    if (life[i] <= 0)
+        dead.push_back(i);
 }
 
-void ParticleSystem::exec_worker_threads(std::function<void(int, int)> spawn_worker)
+void ParticleSystem::update_worker(float time, int start, int end)
 {
-//    return spawn_worker(0, ps.size());
-
-    const int num_threads = std::thread::hardware_concurrency();
-    const int worker_load = (ps.size() + num_threads - 1) / num_threads;
-
-    std::thread workers[num_threads];
-    for (int i = 0; i < num_threads; i++)
+    end = std::min(end, particle_count);
+    auto& dead = died[start / particles_per_task];
+
+    int i = start;
+#ifdef PARTICLE_SIMD
+    using namespace simd;
+    const vec_t zero = splat(0), one = splat(1), minus_one = splat(-1);
+    for (; i + width <= end; i += width)
     {
-        int thread_start = i * worker_load;
-        int thread_end = (i + 1) * worker_load;
-        thread_end = std::min(thread_end, (int)ps.size());
+        vec_t l = load(&life[i]);
+        vec_t alive = less(zero, l);
+        if (!mask_bits(alive))
+            continue;
 
-        workers[i] = std::thread([=] () { spawn_worker(thread_start, thread_end); });
+        /* Compute the new state of all lanes, but store it only for the
+         * particles which were alive */
+        vec_t cx = load(&center_x[i]), cy = load(&center_y[i]);
+        vec_t sx = load(&speed_x[i]), sy = load(&speed_y[i]);
+        vec_t gx = load(&g_x[i]);
+
+        vec_t new_cx = add(cx, mul(sx, splat(speed_step)));
+        vec_t new_cy = add(cy, mul(sy, splat(speed_step)));
+        vec_t new_sx = add(sx, mul(gx, splat(g_step)));
+        vec_t new_sy = add(sy, mul(load(&g_y[i]), splat(g_step)));
+
+        vec_t new_life = sub(l, mul(load(&fade[i]), splat(fade_step)));
+        vec_t positive_life = max(new_life, zero);
+        vec_t new_alpha = mul(div(load(&alpha[i]), l), positive_life);
+        vec_t new_radius = mul(load(&base_radius[i]), sqrt(positive_life));
+        vec_t new_gx = select(less(load(&start_x[i]), new_cx), minus_one, one);
+
+        store(&center_x[i], select(alive, new_cx, cx));
+        store(&center_y[i], select(alive, new_cy, cy));
+        store(&speed_x[i], select(alive, new_sx, sx));
+        store(&speed_y[i], select(alive, new_sy, sy));
+        store(&g_x[i], select(alive, new_gx, gx));
+        store(&alpha[i], select(alive, new_alpha, load(&alpha[i])));
+        store(&radius[i], select(alive, new_radius, load(&radius[i])));
+        store(&life[i], select(alive, new_life, l));
+
+        int died_now = mask_bits(alive) & ~mask_bits(less(zero, new_life));
+        for (int j = 0; j < width; j++)
+        {
+            if (died_now & (1 << j))
+                dead.push_back(i + j);
+        }
     }
+#endif
 
-    for (auto& w : workers)
-        w.join();
+    for (; i < end; i++)
+        update_particle(i, dead);
+}
+
+void ParticleSystem::exec_worker_threads(std::function<void(int, int)> spawn_worker)
+{
+    wf::get_core().thread_pool->parallel_for(0, particle_count,
+        particles_per_task, spawn_worker);
 }
 
 void ParticleSystem::update()
@@ -148,14 +303,33 @@ void ParticleSystem::update()
     float time = (get_current_time() - last_update_msec) / 16.0;
     last_update_msec = get_current_time();
 
+    if (use_gpu)
+    {
+        update_gpu();
+        return;
+    }
+
     exec_worker_threads([=] (int start, int end) {
         update_worker(time, start, end);
     });
+
+    for (auto& list : died)
+    {
+        free_list.insert(free_list.end(), list.begin(), list.end());
+        list.clear();
+    }
 }
 
 int ParticleSystem::statistic()
 {
-    return particles_alive;
+    if (!use_gpu)
+        return particle_count - (int)free_list.size();
+
+    int alive = 0;
+    for (int spawned : recent_spawns)
+        alive += spawned;
+
+    return std::min(alive, particle_count);
 }
 
 void ParticleSystem::create_program()
@@ -168,81 +342,275 @@ void ParticleSystem::create_program()
 
     program.radius    = GL_CALL(glGetAttribLocation(program.id, "radius"));
     program.position  = GL_CALL(glGetAttribLocation(program.id, "position"));
-    program.center    = GL_CALL(glGetAttribLocation(program.id, "center"));
+    program.center_x  = GL_CALL(glGetAttribLocation(program.id, "center_x"));
+    program.center_y  = GL_CALL(glGetAttribLocation(program.id, "center_y"));
     program.color     = GL_CALL(glGetAttribLocation(program.id, "color"));
+    program.alpha     = GL_CALL(glGetAttribLocation(program.id, "alpha"));
     program.matrix    = GL_CALL(glGetUniformLocation(program.id, "matrix"));
     program.smoothing = GL_CALL(glGetUniformLocation(program.id, "smoothing"));
+    program.color_scale =
+        GL_CALL(glGetUniformLocation(program.id, "color_scale"));
+
+    /* Transform feedback and gl_VertexID need GLES 3.0 */
+    if (OpenGL::context_supports_gles3())
+        create_update_program();
 
     OpenGL::render_end();
 }
 
-void ParticleSystem::render(glm::mat4 matrix)
+void ParticleSystem::create_update_program()
 {
-    GL_CALL(glUseProgram(program.id));
-
-    static float vertex_data[] = {
-        -1, -1,
-         1, -1,
-         1,  1,
-        -1,  1
+    /* The transform feedback varyings have to be set before linking, so the
+     * program isn't created with OpenGL::create_program_from_source() */
+    GLuint vertex_shader = OpenGL::compile_shader(particle_update_vert_source,
+        GL_VERTEX_SHADER);
+    GLuint fragment_shader = OpenGL::compile_shader(
+        particle_update_frag_source, GL_FRAGMENT_SHADER);
+
+    auto& prog = update_program;
+    prog.id = GL_CALL(glCreateProgram());
+    GL_CALL(glAttachShader(prog.id, vertex_shader));
+    GL_CALL(glAttachShader(prog.id, fragment_shader));
+
+    static const char *varyings[] = {
+        "out_state0", "out_state1", "out_state2", "out_state3"
     };
+    GL_CALL(glTransformFeedbackVaryings(prog.id, 4, varyings,
+            GL_INTERLEAVED_ATTRIBS));
+    GL_CALL(glLinkProgram(prog.id));
 
-    // position
-    GL_CALL(glEnableVertexAttribArray(program.position));
-    GL_CALL(glVertexAttribPointer(program.position, 2, GL_FLOAT,
-                                  false, 0, vertex_data));
-    GL_CALL(glVertexAttribDivisor(program.position, 0));
+    /* won't be really deleted until program is deleted as well */
+    GL_CALL(glDeleteShader(vertex_shader));
+    GL_CALL(glDeleteShader(fragment_shader));
 
-    // particle radius
-    GL_CALL(glEnableVertexAttribArray(program.radius));
-    GL_CALL(glVertexAttribPointer(program.radius, 1, GL_FLOAT,
-                                  false, 0, radius.data()));
-    GL_CALL(glVertexAttribDivisor(program.radius, 1));;
+    GLint status = GL_FALSE;
+    GL_CALL(glGetProgramiv(prog.id, GL_LINK_STATUS, &status));
+    if (status != GL_TRUE)
+    {
+        log_error("failed to link the particle update program, "
+            "particles will be simulated on the CPU");
+        GL_CALL(glDeleteProgram(prog.id));
+        prog.id = 0;
+        return;
+    }
+
+    prog.spawn_start = GL_CALL(glGetUniformLocation(prog.id, "spawn_start"));
+    prog.spawn_count = GL_CALL(glGetUniformLocation(prog.id, "spawn_count"));
+    prog.particle_count =
+        GL_CALL(glGetUniformLocation(prog.id, "particle_count"));
+    prog.seed      = GL_CALL(glGetUniformLocation(prog.id, "seed"));
+    prog.pos_min   = GL_CALL(glGetUniformLocation(prog.id, "pos_min"));
+    prog.pos_max   = GL_CALL(glGetUniformLocation(prog.id, "pos_max"));
+    prog.speed_min = GL_CALL(glGetUniformLocation(prog.id, "speed_min"));
+    prog.speed_max = GL_CALL(glGetUniformLocation(prog.id, "speed_max"));
+    prog.g         = GL_CALL(glGetUniformLocation(prog.id, "g"));
+    prog.fade      = GL_CALL(glGetUniformLocation(prog.id, "fade"));
+    prog.radius    = GL_CALL(glGetUniformLocation(prog.id, "radius"));
+    prog.color_min = GL_CALL(glGetUniformLocation(prog.id, "color_min"));
+    prog.color_max = GL_CALL(glGetUniformLocation(prog.id, "color_max"));
+
+    /* The state buffers are created by resize() */
+    GL_CALL(glGenVertexArrays(2, state_vao));
+    use_gpu = true;
+}
+
+void ParticleSystem::resize_gpu(int num)
+{
+    const size_t state_size = floats_per_state * sizeof(float);
+    const int kept = std::min(num, particle_count);
+
+    /* New particles are dead, because their life is 0 */
+    std::vector<float> initial_state(num * floats_per_state, 0);
+
+    OpenGL::render_begin();
+    for (int i = 0; i < 2; i++)
+    {
+        GLuint resized;
+        GL_CALL(glGenBuffers(1, &resized));
+        GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, resized));
+        GL_CALL(glBufferData(GL_ARRAY_BUFFER, num * state_size,
+                initial_state.data(), GL_DYNAMIC_COPY));
+
+        if (kept > 0)
+        {
+            GL_CALL(glBindBuffer(GL_COPY_READ_BUFFER, state_buffer[i]));
+            GL_CALL(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_ARRAY_BUFFER,
+                    0, 0, kept * state_size));
+        }
+
+        GL_CALL(glDeleteBuffers(1, &state_buffer[i]));
+        state_buffer[i] = resized;
+
+        /* The state is read as 4 vec4s, state0-3 in the update program */
+        GL_CALL(glBindVertexArray(state_vao[i]));
+        for (int j = 0; j < floats_per_state / 4; j++)
+        {
+            GL_CALL(glEnableVertexAttribArray(j));
+            GL_CALL(glVertexAttribPointer(j, 4, GL_FLOAT, GL_FALSE,
+                    state_size, (void*)(j * 4 * sizeof(float))));
+        }
+    }
+
+    GL_CALL(glBindVertexArray(0));
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    GL_CALL(glBindBuffer(GL_COPY_READ_BUFFER, 0));
+    OpenGL::render_end();
 
+    spawn_cursor = num > 0 ? spawn_cursor % num : 0;
+    pending_spawns = std::min(pending_spawns, num);
+}
+
+int ParticleSystem::get_max_particle_updates()
+{
+    /* Particles start with life 1, which decreases by at least
+     * fade_min * fade_step in each update */
+    float min_fade = std::min(emitter.fade_min, emitter.fade_max);
+    return std::ceil(1.0 / (std::max(min_fade, 0.01f) * fade_step));
+}
+
+void ParticleSystem::update_gpu()
+{
+    const int spawn_count = pending_spawns;
+    pending_spawns = 0;
+
+    recent_spawns.push_back(spawn_count);
+    while ((int)recent_spawns.size() > get_max_particle_updates())
+        recent_spawns.pop_front();
+
+    if (particle_count == 0)
+        return;
+
+    /* A new seed for the random values of the spawned particles */
+    spawn_seed = spawn_seed * 1664525u + 1013904223u;
+
+    /* Just load the proper context, viewport doesn't matter */
+    OpenGL::render_begin();
+
+    auto& prog = update_program;
+    OpenGL::use_program(prog.id);
+    GL_CALL(glUniform1i(prog.spawn_start, spawn_cursor));
+    GL_CALL(glUniform1i(prog.spawn_count, spawn_count));
+    GL_CALL(glUniform1i(prog.particle_count, particle_count));
+    GL_CALL(glUniform1ui(prog.seed, spawn_seed));
+    GL_CALL(glUniform2f(prog.pos_min, emitter.pos_min.x, emitter.pos_min.y));
+    GL_CALL(glUniform2f(prog.pos_max, emitter.pos_max.x, emitter.pos_max.y));
+    GL_CALL(glUniform2f(prog.speed_min,
+            emitter.speed_min.x, emitter.speed_min.y));
+    GL_CALL(glUniform2f(prog.speed_max,
+            emitter.speed_max.x, emitter.speed_max.y));
+    GL_CALL(glUniform2f(prog.g, emitter.g.x, emitter.g.y));
+    GL_CALL(glUniform2f(prog.fade, emitter.fade_min, emitter.fade_max));
+    GL_CALL(glUniform2f(prog.radius, emitter.radius_min, emitter.radius_max));
+    GL_CALL(glUniform4fv(prog.color_min, 1, &emitter.color_min[0]));
+    GL_CALL(glUniform4fv(prog.color_max, 1, &emitter.color_max[0]));
+
+    /* Read the current state, and write the new state to the other buffer
+     * without rasterizing anything */
+    const int next_state = 1 - current_state;
+    GL_CALL(glBindVertexArray(state_vao[current_state]));
+    GL_CALL(glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0,
+            state_buffer[next_state]));
+
+    OpenGL::enable(GL_RASTERIZER_DISCARD);
+    GL_CALL(glBeginTransformFeedback(GL_POINTS));
+    GL_CALL(glDrawArrays(GL_POINTS, 0, particle_count));
+    GL_CALL(glEndTransformFeedback());
+    OpenGL::disable(GL_RASTERIZER_DISCARD);
+
+    GL_CALL(glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0));
+    GL_CALL(glBindVertexArray(0));
+    OpenGL::use_program(0);
+
+    OpenGL::render_end();
+
+    spawn_cursor = (spawn_cursor + spawn_count) % particle_count;
+    current_state = next_state;
+}
+
+void ParticleSystem::bind_cpu_attributes()
+{
+    /* Upload everything to the GPU once, both passes of render() use it. The
+     * particle arrays are in the layout of the attributes already. */
+    const size_t array_size = particle_count * sizeof(float);
+    buffer.reserve(sizeof(vertex_data) +
+        array_size * (4 + rgb_per_particle), 6);
+    size_t vertex_offset = buffer.upload(vertex_data, sizeof(vertex_data));
+    size_t radius_offset = buffer.upload(radius.data(), array_size);
+    size_t center_x_offset = buffer.upload(center_x.data(), array_size);
+    size_t center_y_offset = buffer.upload(center_y.data(), array_size);
+    size_t color_offset = buffer.upload(rgb.data(),
+        array_size * rgb_per_particle);
+    size_t alpha_offset = buffer.upload(alpha.data(), array_size);
+
+    buffer.bind();
+
+    // position
+    buffer.set_attribute(program.position, 2, 0, vertex_offset);
+    // particle radius
+    buffer.set_attribute(program.radius, 1, 0, radius_offset, 1);
     // particle center (offset)
-    GL_CALL(glEnableVertexAttribArray(program.center));
-    GL_CALL(glVertexAttribPointer(program.center, 2, GL_FLOAT,
-                                  false, 0, center.data()));
-    GL_CALL(glVertexAttribDivisor(program.center, 1));
+    buffer.set_attribute(program.center_x, 1, 0, center_x_offset, 1);
+    buffer.set_attribute(program.center_y, 1, 0, center_y_offset, 1);
+    // particle color
+    buffer.set_attribute(program.color, 3, 0, color_offset, 1);
+    buffer.set_attribute(program.alpha, 1, 0, alpha_offset, 1);
+}
 
-    // matrix
-    GL_CALL(glUniformMatrix4fv(program.matrix, 1, false, &matrix[0][0]));
+void ParticleSystem::bind_gpu_attributes()
+{
+    buffer.reserve(sizeof(vertex_data), 1);
+    size_t vertex_offset = buffer.upload(vertex_data, sizeof(vertex_data));
 
-    GL_CALL(glEnableVertexAttribArray(program.color));
-    GL_CALL(glVertexAttribDivisor(program.color, 1));
+    buffer.bind();
 
-    /* Darken the background */
-    GL_CALL(glVertexAttribPointer(program.color, 4, GL_FLOAT,
-                                  false, 0, dark_color.data()));
+    // position
+    buffer.set_attribute(program.position, 2, 0, vertex_offset);
+
+    /* The particle attributes are read from the state buffer, see the
+     * layout in particle_update_vert_source */
+    const size_t stride = floats_per_state * sizeof(float);
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, state_buffer[current_state]));
+    buffer.set_attribute(program.center_x, 1, stride, 0 * sizeof(float), 1);
+    buffer.set_attribute(program.center_y, 1, stride, 1 * sizeof(float), 1);
+    buffer.set_attribute(program.radius, 1, stride, 10 * sizeof(float), 1);
+    buffer.set_attribute(program.alpha, 1, stride, 11 * sizeof(float), 1);
+    buffer.set_attribute(program.color, 3, stride, 12 * sizeof(float), 1);
+}
 
-    GL_CALL(glEnable(GL_BLEND));
-    GL_CALL(glBlendFunc(GL_ZERO, GL_ONE_MINUS_SRC_ALPHA));
+void ParticleSystem::render(glm::mat4 matrix)
+{
+    OpenGL::use_program(program.id);
+
+    if (use_gpu)
+    {
+        bind_gpu_attributes();
+    } else
+    {
+        bind_cpu_attributes();
+    }
+
+    // matrix
+    GL_CALL(glUniformMatrix4fv(program.matrix, 1, false, &matrix[0][0]));
+
+    /* Darken the background with half of the particle color */
+    OpenGL::enable(GL_BLEND);
+    OpenGL::blend_func(GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
     GL_CALL(glUniform1f(program.smoothing, 0.7f));
+    GL_CALL(glUniform1f(program.color_scale, 0.5f));
     // TODO: optimize shaders for this case
-    GL_CALL(glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, ps.size()));
+    GL_CALL(glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, particle_count));
 
-    // particle color
-    GL_CALL(glVertexAttribPointer(program.color, 4, GL_FLOAT,
-                                  false, 0, color.data()));
-    GL_CALL(glBlendFunc(GL_SRC_ALPHA, GL_ONE));
+    OpenGL::blend_func(GL_SRC_ALPHA, GL_ONE);
     GL_CALL(glUniform1f(program.smoothing, 0.5f));
-    GL_CALL(glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, ps.size()));
-
-    GL_CALL(glDisable(GL_BLEND));
+    GL_CALL(glUniform1f(program.color_scale, 1.0f));
+    GL_CALL(glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, particle_count));
 
-    // reset vertex attrib state, other renderers may need this
-    GL_CALL(glVertexAttribDivisor(program.position, 0));
-    GL_CALL(glVertexAttribDivisor(program.radius, 0));;
-    GL_CALL(glVertexAttribDivisor(program.center, 0));
-    GL_CALL(glVertexAttribDivisor(program.color, 0));
+    OpenGL::disable(GL_BLEND);
 
-    GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
-    GL_CALL(glUseProgram(0));
+    /* The attribute state lives in the vertex array of the buffer, so
+     * other renderers are not affected by it */
+    buffer.unbind();
 
-    GL_CALL(glDisableVertexAttribArray(program.position));
-    GL_CALL(glDisableVertexAttribArray(program.radius));
-    GL_CALL(glDisableVertexAttribArray(program.center));
-    GL_CALL(glDisableVertexAttribArray(program.color));
+    OpenGL::blend_func(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    OpenGL::use_program(0);
 }
-
-
@@ -2,42 +2,45 @@
 #define ANIMATION_FIRE_PARTICLE_HPP
 
 #include <opengl.hpp>
+#include <deque>
 #include <functional>
-#include <atomic>
 #include <vector>
 
-struct Particle
+/* Describes the particles created by spawn(). Each property of a new particle
+ * is picked at random from the given range. Particles start with life 1. */
+struct ParticleEmitter
 {
-    float life = -1;
-    float fade;
+    glm::vec2 pos_min{0.0, 0.0}, pos_max{0.0, 0.0};
+    glm::vec2 speed_min{0.0, 0.0}, speed_max{0.0, 0.0};
 
-    float radius, base_radius;
+    /* The initial acceleration. Its x component is updated each frame, so
+     * that the particles move back to the x where they started. */
+    glm::vec2 g{0.0, 0.0};
 
-    glm::vec2 pos{0.0, 0.0}, speed{0.0, 0.0}, g{0.0, 0.0};
-    glm::vec2 start_pos;
+    float fade_min = 0.5, fade_max = 0.5;
+    float radius_min = 1, radius_max = 1;
 
-    glm::vec4 color{1.0, 1.0, 1.0, 1.0};
-
-    /* update the given particle
-     * time is the percentage of the frame which has elapsed
-     * must be thread-safe */
-    void update(float time);
+    glm::vec4 color_min{1.0, 1.0, 1.0, 1.0}, color_max{1.0, 1.0, 1.0, 1.0};
 };
 
-/* a function to initialize a particle */
-using ParticleIniter = std::function<void(Particle&)>;
-
+/* The particles are simulated on the GPU with transform feedback if the
+ * context supports GLES 3.0, and on the CPU with the core thread pool
+ * otherwise */
 class ParticleSystem
 {
     public:
         /* the user of this class has to set up a proper GL context
          * before creating the ParticleSystem */
-        ParticleSystem(int num_part,
-                       ParticleIniter part_init_func);
+        ParticleSystem(int num_part);
         ~ParticleSystem();
 
+        /* set the emitter used by the next calls to spawn() */
+        void set_emitter(const ParticleEmitter& emitter);
+
         /* spawn at most num new particles.
-         * returns the number of actually spawned particles */
+         * returns the number of actually spawned particles. When simulating
+         * on the GPU, particles are spawned by the next update(), and this
+         * is only an upper bound. */
         int spawn(int num);
 
         /* change the maximal number of particles
@@ -50,7 +53,9 @@ class ParticleSystem
         /* update all particles */
         void update();
 
-        // number of particles alive
+        /* number of particles alive. When simulating on the GPU, this is the
+         * number of particles spawned recently enough that they may still be
+         * alive. */
         int statistic();
 
         /* render particles, each will be multiplied by matrix
@@ -61,32 +66,98 @@ class ParticleSystem
     private:
         ParticleSystem() = delete;
 
-        ParticleIniter pinit_func;
+        ParticleEmitter emitter;
         uint32_t last_update_msec;
+        int particle_count = 0;
+
+        /* Whether the particles are simulated with transform feedback */
+        bool use_gpu = false;
+
+        /* CPU path.
+         *
+         * The particles are stored as a structure of arrays, so that the
+         * update kernel can work on several particles at once with SIMD, and
+         * the arrays used for rendering (center_x/y, radius, rgb and alpha)
+         * can be uploaded to the GPU as they are.
+         *
+         * Dead particles have life <= 0 and radius 0, so they are not
+         * visible, and their indices are kept in free_list. */
+        std::vector<float> life, fade, radius, base_radius;
+        std::vector<float> center_x, center_y, speed_x, speed_y, g_x, g_y;
+        std::vector<float> start_x;
+        std::vector<float> alpha;
+
+        static constexpr int rgb_per_particle = 3;
+        std::vector<float> rgb;
+
+        std::vector<int> free_list;
+
+        /* Particles which died during update(), one list per range of
+         * particles updated in parallel. They are added to free_list after
+         * the update, and keep their storage between frames. */
+        static constexpr int particles_per_task = 256;
+        std::vector<std::vector<int>> died;
+
+        /* GPU path.
+         *
+         * The state of the particles is stored in two buffers, with
+         * floats_per_state floats per particle. update() draws one point per
+         * particle from the current buffer, and the update program writes
+         * the new state to the other buffer with transform feedback. Dead
+         * particles have life <= 0 and radius 0, like on the CPU.
+         *
+         * spawn() only counts the particles to spawn. The next update()
+         * revives the dead particles among the next pending_spawns particles
+         * after spawn_cursor, with random values generated in the shader. */
+        static constexpr int floats_per_state = 16;
+        GLuint state_buffer[2] = {0, 0};
+        /* The vertex arrays which read the buffers in the update pass */
+        GLuint state_vao[2] = {0, 0};
+        int current_state = 0;
+
+        int spawn_cursor = 0, pending_spawns = 0;
+        uint32_t spawn_seed = 0;
+        /* The number of particles spawned by each of the last updates, as
+         * many updates as the longest living particle lasts */
+        std::deque<int> recent_spawns;
 
-        std::atomic<int> particles_alive;
-        std::vector<Particle> ps;
-
-        static constexpr int color_per_particle = 4;
-        std::vector<float> color, dark_color;
-
-        static constexpr int radius_per_particle = 1;
-        std::vector<float> radius;
-
-        static constexpr int center_per_particle = 2;
-        std::vector<float> center;
-
+        struct {
+            GLuint id = 0;
+            GLuint spawn_start, spawn_count, particle_count, seed;
+            GLuint pos_min, pos_max, speed_min, speed_max, g;
+            GLuint fade, radius, color_min, color_max;
+        } update_program;
 
         struct {
             GLuint id;
-            GLuint radius, position, center, color;
-            GLuint smoothing;
+            GLuint radius, position, center_x, center_y, color, alpha;
+            GLuint smoothing, color_scale;
             GLuint matrix;
         } program;
 
+        /* Holds the quad vertices and the per-particle attributes */
+        wf_gpu_buffer buffer{GL_ARRAY_BUFFER, WF_BUFFER_STREAMING};
+
+        void create_program();
+
+        int spawn_cpu(int num);
+        void resize_cpu(int num);
+        /* Run spawn_worker for ranges of particles on the core thread pool */
         void exec_worker_threads(std::function<void(int, int)> spawn_worker);
         void update_worker(float time, int start, int end);
-        void create_program();
+        void update_particle(int i, std::vector<int>& dead);
+        /* Upload the particle arrays and set up the attributes for render().
+         * The buffer must be bound. */
+        void bind_cpu_attributes();
+
+        void create_update_program();
+        void resize_gpu(int num);
+        void update_gpu();
+        /* The number of updates until a new particle is surely dead */
+        int get_max_particle_updates();
+        /* Set up the attributes for render() from the current state buffer.
+         * The buffer must be bound. */
+        void bind_gpu_attributes();
 };
 
 
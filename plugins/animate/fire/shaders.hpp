@@ -7,10 +7,13 @@ R"(
 
 attribute mediump float radius;
 attribute mediump vec2 position;
-attribute mediump vec2 center;
-attribute mediump vec4 color;
+attribute mediump float center_x;
+attribute mediump float center_y;
+attribute mediump vec3 color;
+attribute mediump float alpha;
 
 uniform mat4 matrix;
+uniform mediump float color_scale;
 
 varying mediump vec2 uv;
 varying mediump vec4 out_color;
@@ -18,10 +21,10 @@ varying mediump float R;
 
 void main() {
     uv = position * radius;
-    gl_Position = matrix * vec4(center.x + uv.x * 0.75, center.y + uv.y, 0.0, 1.0);
+    gl_Position = matrix * vec4(center_x + uv.x * 0.75, center_y + uv.y, 0.0, 1.0);
 
     R = radius;
-    out_color = color;
+    out_color = vec4(color, alpha) * color_scale;
 }
 )";
 
@@ -50,4 +53,130 @@ void main()
 }
 )";
 
+/* Updates the particles on the GPU, see ParticleSystem::update_gpu().
+ * state0-3 are written to the other state buffer with transform feedback:
+ *
+ * state0 = center.xy, speed.xy
+ * state1 = g.xy, start_x, life
+ * state2 = fade, base_radius, radius, alpha
+ * state3 = rgb, unused */
+static const char *particle_update_vert_source =
+R"(#version 300 es
+
+layout(location = 0) in vec4 state0;
+layout(location = 1) in vec4 state1;
+layout(location = 2) in vec4 state2;
+layout(location = 3) in vec4 state3;
+
+out vec4 out_state0;
+out vec4 out_state1;
+out vec4 out_state2;
+out vec4 out_state3;
+
+uniform int spawn_start;
+uniform int spawn_count;
+uniform int particle_count;
+uniform uint seed;
+
+uniform vec2 pos_min, pos_max;
+uniform vec2 speed_min, speed_max;
+uniform vec2 g;
+uniform vec2 fade;
+uniform vec2 radius;
+uniform vec4 color_min, color_max;
+
+const float slowdown = 0.8;
+
+uint random_state;
+
+/* A uniformly distributed float in [0, 1] */
+float random()
+{
+    /* xorshift32 */
+    random_state ^= random_state << 13u;
+    random_state ^= random_state >> 17u;
+    random_state ^= random_state << 5u;
+    return float(random_state) / 4294967295.0;
+}
+
+float random(float s, float e)
+{
+    return mix(s, e, random());
+}
+
+vec2 random(vec2 s, vec2 e)
+{
+    return vec2(random(s.x, e.x), random(s.y, e.y));
+}
+
+void main()
+{
+    vec2 center = state0.xy;
+    vec2 speed = state0.zw;
+    vec2 accel = state1.xy;
+    float start_x = state1.z;
+    float life = state1.w;
+    float fade_speed = state2.x;
+    float base_radius = state2.y;
+    float current_radius = state2.z;
+    float alpha = state2.w;
+    vec3 color = state3.rgb;
+
+    int offset = gl_VertexID - spawn_start;
+    if (offset < 0)
+        offset += particle_count;
+
+    if (life <= 0.0 && offset < spawn_count)
+    {
+        /* Different for each particle and each update, and never 0 */
+        random_state = (uint(gl_VertexID) + 1u) * 2654435761u ^ seed;
+        if (random_state == 0u)
+            random_state = 1u;
+
+        life = 1.0;
+        fade_speed = random(fade.x, fade.y);
+        center = random(pos_min, pos_max);
+        start_x = center.x;
+        speed = random(speed_min, speed_max);
+        accel = g;
+        base_radius = random(radius.x, radius.y);
+        color = vec3(random(color_min.r, color_max.r),
+            random(color_min.g, color_max.g),
+            random(color_min.b, color_max.b));
+        alpha = random(color_min.a, color_max.a);
+    }
+
+    if (life > 0.0)
+    {
+        center += speed * 0.2 * slowdown;
+        speed += accel * 0.3 * slowdown;
+
+        float new_life = life - fade_speed * 0.3 * slowdown;
+        alpha = alpha / life * max(new_life, 0.0);
+        current_radius = base_radius * sqrt(max(new_life, 0.0));
+        life = new_life;
+
+        accel.x = start_x < center.x ? -1.0 : 1.0;
+    }
+
+    out_state0 = vec4(center, speed);
+    out_state1 = vec4(accel, start_x, life);
+    out_state2 = vec4(fade_speed, base_radius, current_radius, alpha);
+    out_state3 = vec4(color, 0.0);
+}
+)";
+
+/* GLES requires a fragment shader, even though nothing is rasterized */
+static const char *particle_update_frag_source =
+R"(#version 300 es
+
+precision mediump float;
+out vec4 out_color;
+
+void main()
+{
+    out_color = vec4(0.0);
+}
+)";
+
 #endif /* end of include guard: PARTICLE_ANIMATION_SHADER */
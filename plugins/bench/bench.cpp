@@ -0,0 +1,407 @@
+#include <plugin.hpp>
+#include <output.hpp>
+#include <core.hpp>
+#include <debug.hpp>
+#include <opengl.hpp>
+#include <compositor-view.hpp>
+#include <render-manager.hpp>
+#include <workspace-manager.hpp>
+#include <workspace-stream.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+/**
+ * The bench plugin creates synthetic views on its output and drives a scripted
+ * workload through the render pipeline. After the configured number of frames
+ * have been repainted, it prints frame-time percentiles for each repaint phase
+ * and terminates the compositor.
+ *
+ * It is meant to be run on the headless backend, see wayfire-bench.sh.
+ *
+ * Options in the [bench] section:
+ *
+ * views         - the number of synthetic views
+ * layout        - grid, cascade or stack
+ * workload      - damage, move, resize or mixed
+ * damage_rects  - the number of small rects to damage per view and frame,
+ *                 when using the damage workload
+ * streams       - if enabled, a render hook updates the workspace stream of
+ *                 every workspace each frame, similar to expo
+ * warmup_frames - the number of frames to ignore at the start
+ * frames        - the number of frames to measure
+ */
+namespace
+{
+/* Number of bench instances which haven't finished yet */
+int running_benchmarks = 0;
+/* Whether a bench instance has finished and printed its report */
+bool reported_benchmarks = false;
+}
+
+class wayfire_bench : public wf::plugin_interface_t
+{
+    wf_option views_opt, layout_opt, workload_opt, damage_rects_opt,
+        streams_opt, warmup_frames_opt, frames_opt;
+
+    std::vector<nonstd::observer_ptr<wf::color_rect_view_t>> views;
+    std::vector<wf_geometry> base_geometry;
+
+    std::vector<std::vector<wf::workspace_stream_t>> streams;
+    wf::render_hook_t streams_renderer;
+
+    std::vector<wf::frame_statistics_t> measured_frames;
+    int frame_counter = 0;
+    bool running = false;
+    /* Whether this instance is counted in running_benchmarks. Set from init()
+     * until the instance finishes, even before start() runs */
+    bool counted = false;
+
+    wf::wl_idle_call idle_start;
+    wf::wl_timer watchdog;
+
+    public:
+    void init(wayfire_config *config)
+    {
+        grab_interface->name = "bench";
+        grab_interface->capabilities = 0;
+
+        auto section = config->get_section("bench");
+        views_opt         = section->get_option("views", "32");
+        layout_opt        = section->get_option("layout", "grid");
+        workload_opt      = section->get_option("workload", "mixed");
+        damage_rects_opt  = section->get_option("damage_rects", "8");
+        streams_opt       = section->get_option("streams", "0");
+        warmup_frames_opt = section->get_option("warmup_frames", "60");
+        frames_opt        = section->get_option("frames", "600");
+
+        ++running_benchmarks;
+        counted = true;
+        /* Wait until the output has been fully set up */
+        idle_start.run_once([=] () { start(); });
+    }
+
+    wf_geometry get_layout_geometry(int idx, int total)
+    {
+        auto og = output->get_relative_geometry();
+        auto layout = layout_opt->as_string();
+
+        if (layout == "stack")
+            return {og.width / 8, og.height / 8, og.width * 3 / 4, og.height * 3 / 4};
+
+        if (layout == "cascade")
+        {
+            const int step = 30;
+            int w = og.width / 2, h = og.height / 2;
+            int max_steps = std::max(1,
+                std::min((og.width - w) / step, (og.height - h) / step));
+
+            return {(idx % max_steps) * step, (idx % max_steps) * step, w, h};
+        }
+
+        /* Grid layout */
+        int columns = std::ceil(std::sqrt(total));
+        int rows = (total + columns - 1) / columns;
+        int w = og.width / columns, h = og.height / rows;
+
+        return {(idx % columns) * w, (idx / columns) * h, w, h};
+    }
+
+    void start()
+    {
+        int count = std::max(views_opt->as_int(), 0);
+        for (int i = 0; i < count; i++)
+        {
+            auto view = new wf::color_rect_view_t();
+            wf::get_core().add_view(std::unique_ptr<wf::view_interface_t> (view));
+
+            auto geometry = get_layout_geometry(i, count);
+            view->set_output(output);
+            view->set_geometry(geometry);
+            view->set_color({(i % 3) / 2.0, (i % 5) / 4.0, (i % 7) / 6.0, 1.0});
+            view->set_border_color({1, 1, 1, 1});
+            view->set_border(2);
+            output->workspace->add_view(view->self(), wf::LAYER_WORKSPACE);
+
+            views.push_back(nonstd::make_observer(view));
+            base_geometry.push_back(geometry);
+        }
+
+        if (streams_opt->as_int())
+            start_streams();
+
+        output->render->add_effect(&step_workload, wf::OUTPUT_EFFECT_PRE);
+        output->render->connect_signal("frame-stats", &on_frame_stats);
+        output->render->set_redraw_always();
+        running = true;
+
+        /* Do not hang forever if the output never repaints */
+        watchdog.set_timeout(60 * 1000, [=] ()
+        {
+            log_error("bench: timed out after %d frames", frame_counter);
+            finish();
+        });
+
+        log_info("bench: started with %d views on output %s", count,
+            output->handle->name);
+    }
+
+    void start_streams()
+    {
+        auto wsize = output->workspace->get_workspace_grid_size();
+        streams.resize(wsize.width);
+        for (int i = 0; i < wsize.width; i++)
+        {
+            streams[i].resize(wsize.height);
+            for (int j = 0; j < wsize.height; j++)
+            {
+                streams[i][j].ws = {i, j};
+                output->render->workspace_stream_start(streams[i][j]);
+            }
+        }
+
+        streams_renderer = [=] (const wf_framebuffer& fb)
+        {
+            for (auto& column : streams)
+            {
+                for (auto& stream : column)
+                    output->render->workspace_stream_update(stream);
+            }
+
+            auto cws = output->workspace->get_current_workspace();
+            auto& current = streams[cws.x][cws.y];
+
+            gl_geometry geometry = {0, 0,
+                1.0f * fb.geometry.width, 1.0f * fb.geometry.height};
+
+            OpenGL::render_begin(fb);
+            OpenGL::render_transformed_texture(current.buffer.tex, geometry, {},
+                fb.get_orthographic_projection(), glm::vec4(1.0),
+                TEXTURE_TRANSFORM_INVERT_Y);
+            OpenGL::render_end();
+        };
+
+        output->render->set_renderer(streams_renderer);
+    }
+
+    void stop_streams()
+    {
+        if (streams.empty())
+            return;
+
+        output->render->set_renderer(nullptr);
+        OpenGL::render_begin();
+        for (auto& column : streams)
+        {
+            for (auto& stream : column)
+            {
+                output->render->workspace_stream_stop(stream);
+                stream.buffer.release();
+            }
+        }
+        OpenGL::render_end();
+
+        streams.clear();
+    }
+
+    void damage_view(size_t idx)
+    {
+        auto g = views[idx]->get_wm_geometry();
+        if (g.width <= 16 || g.height <= 16)
+            return;
+
+        /* Emulate a client which updates small parts of its contents, like
+         * a terminal or an editor */
+        int rects = damage_rects_opt->as_int();
+        for (int i = 0; i < rects; i++)
+        {
+            int seed = frame_counter * 31 + i * 17 + idx * 7;
+            int x = g.x + (seed * 13) % (g.width - 16);
+            int y = g.y + (seed * 29) % (g.height - 16);
+
+            output->render->damage(
+                output->render->get_target_framebuffer()
+                    .damage_box_from_geometry_box({x, y, 16, 16}));
+        }
+    }
+
+    void move_view(size_t idx)
+    {
+        auto& base = base_geometry[idx];
+        float t = (frame_counter + idx * 11) / 30.0;
+
+        views[idx]->move(base.x + 50 * std::sin(t), base.y + 50 * std::cos(t));
+    }
+
+    void resize_view(size_t idx)
+    {
+        auto& base = base_geometry[idx];
+        float t = (frame_counter + idx * 11) / 30.0;
+
+        views[idx]->resize(std::max(32.0, base.width * (0.75 + 0.25 * std::sin(t))),
+            std::max(32.0, base.height * (0.75 + 0.25 * std::cos(t))));
+    }
+
+    wf::effect_hook_t step_workload = [=] ()
+    {
+        auto workload = workload_opt->as_string();
+        for (size_t i = 0; i < views.size(); i++)
+        {
+            int pattern = i % 3;
+            if (workload == "damage")
+                pattern = 0;
+            else if (workload == "move")
+                pattern = 1;
+            else if (workload == "resize")
+                pattern = 2;
+
+            switch (pattern)
+            {
+                case 0:
+                    damage_view(i);
+                    break;
+                case 1:
+                    move_view(i);
+                    break;
+                case 2:
+                    resize_view(i);
+                    break;
+            }
+        }
+
+        ++frame_counter;
+    };
+
+    wf::signal_callback_t on_frame_stats = [=] (wf::signal_data_t *data)
+    {
+        auto stats = static_cast<wf::frame_stats_signal*> (data)->stats;
+        if (frame_counter <= warmup_frames_opt->as_int())
+            return;
+
+        measured_frames.push_back(*stats);
+        if ((int)measured_frames.size() >= frames_opt->as_int())
+            finish();
+    };
+
+    static int64_t percentile(std::vector<int64_t> values, int p)
+    {
+        if (values.empty())
+            return 0;
+
+        std::sort(values.begin(), values.end());
+        size_t idx = std::min(values.size() - 1, values.size() * p / 100);
+        return values[idx];
+    }
+
+    void print_row(const char *name, std::vector<int64_t> values)
+    {
+        std::printf("%-18s %10.3f %10.3f %10.3f %10.3f\n", name,
+            percentile(values, 50) / 1000.0, percentile(values, 90) / 1000.0,
+            percentile(values, 99) / 1000.0, percentile(values, 100) / 1000.0);
+    }
+
+    void print_report()
+    {
+        static const char *phase_names[wf::FRAME_PHASE_TOTAL] = {
+            "pre-effects", "render-output", "overlay-effects",
+            "software-cursors", "post-effects", "swap-buffers",
+        };
+
+        std::printf("bench: output %s, %d views, layout %s, workload %s, "
+            "streams %d, %zu frames\n", output->handle->name,
+            (int)views.size(), layout_opt->as_string().c_str(),
+            workload_opt->as_string().c_str(), streams_opt->as_int(),
+            measured_frames.size());
+        std::printf("%-18s %10s %10s %10s %10s\n", "phase (ms)",
+            "p50", "p90", "p99", "max");
+
+        std::vector<int64_t> values(measured_frames.size());
+        for (int phase = 0; phase < wf::FRAME_PHASE_TOTAL; phase++)
+        {
+            for (size_t i = 0; i < measured_frames.size(); i++)
+                values[i] = measured_frames[i].phase_usec[phase];
+            print_row(phase_names[phase], values);
+        }
+
+        for (size_t i = 0; i < measured_frames.size(); i++)
+            values[i] = measured_frames[i].total_usec;
+        print_row("total", values);
+
+        uint64_t damaged = 0, scheduled = 0, culled = 0;
+        uint64_t gl_changes = 0, gl_redundant = 0, allocations = 0;
+        for (auto& frame : measured_frames)
+        {
+            damaged += frame.damaged_pixels;
+            scheduled += frame.surfaces_scheduled;
+            culled += frame.surfaces_culled;
+            gl_changes += frame.gl_state_changes;
+            gl_redundant += frame.gl_redundant_state_changes;
+            allocations += frame.repaint_allocations;
+        }
+
+        size_t n = std::max<size_t>(measured_frames.size(), 1);
+        std::printf("average per frame: %lu damaged pixels, "
+            "%lu scheduled and %lu culled surfaces\n",
+            (unsigned long)(damaged / n), (unsigned long)(scheduled / n),
+            (unsigned long)(culled / n));
+        std::printf("average per frame: %lu GL state changes, "
+            "%lu skipped as redundant\n", (unsigned long)(gl_changes / n),
+            (unsigned long)(gl_redundant / n));
+        std::printf("total repaint allocations: %lu (counted only in debug "
+            "builds)\n", (unsigned long)allocations);
+        std::fflush(stdout);
+    }
+
+    void stop()
+    {
+        if (!running)
+            return;
+
+        running = false;
+        watchdog.disconnect();
+        output->render->rem_effect(&step_workload);
+        output->render->disconnect_signal("frame-stats", &on_frame_stats);
+        output->render->set_redraw_always(false);
+        stop_streams();
+
+        for (auto& view : views)
+            view->close();
+
+        views.clear();
+        base_geometry.clear();
+    }
+
+    void finish()
+    {
+        if (!running)
+            return;
+
+        print_report();
+        stop();
+
+        reported_benchmarks = true;
+        uncount();
+    }
+
+    /* Exit once all benchmarks have finished. The last one may also be on an
+     * output which went away, before or after its benchmark started. */
+    void uncount()
+    {
+        if (!counted)
+            return;
+
+        counted = false;
+        if (--running_benchmarks == 0 && reported_benchmarks)
+            wl_display_terminate(wf::get_core().display);
+    }
+
+    void fini()
+    {
+        idle_start.disconnect();
+        stop();
+        uncount();
+    }
+};
+
+DECLARE_WAYFIRE_PLUGIN(wayfire_bench);
@@ -0,0 +1,76 @@
+#!/bin/sh
+# Run a headless benchmark of the repaint pipeline.
+#
+# Usage: wayfire-bench.sh <path to wayfire> <path to libbench.so>
+#
+# The benchmark is configured through the following environment variables:
+#
+# BENCH_VIEWS         number of synthetic views (default 32)
+# BENCH_LAYOUT        grid, cascade or stack (default grid)
+# BENCH_WORKLOAD      damage, move, resize or mixed (default mixed)
+# BENCH_DAMAGE_RECTS  damaged rects per view and frame (default 8)
+# BENCH_STREAMS       1 to update all workspace streams each frame (default 0)
+# BENCH_FRAMES        number of measured frames (default 600)
+# BENCH_WARMUP        number of frames to skip before measuring (default 60)
+# BENCH_MODE          output mode, for ex. 1920x1080@60000 (default 1920x1080)
+# BENCH_OUTPUTS       number of headless outputs (default 1)
+# BENCH_STRICT        1 to abort if a steady-state repaint allocates, only
+#                     checked in debug builds (default 0)
+#
+# Results are printed to stdout, one table per output.
+
+set -e
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 <wayfire> <libbench.so>" >&2
+    exit 1
+fi
+
+wayfire="$1"
+plugin="$(cd "$(dirname "$2")" && pwd)/$(basename "$2")"
+
+config="$(mktemp "${TMPDIR:-/tmp}/wayfire-bench.XXXXXX")"
+trap 'rm -f "$config"' EXIT
+
+outputs="${BENCH_OUTPUTS:-1}"
+mode="${BENCH_MODE:-1920x1080}"
+
+{
+    echo "[core]"
+    echo "plugins = $plugin"
+    echo "vwidth = 3"
+    echo "vheight = 3"
+    echo "abort_on_repaint_allocations = ${BENCH_STRICT:-0}"
+    echo
+    echo "[bench]"
+    echo "views = ${BENCH_VIEWS:-32}"
+    echo "layout = ${BENCH_LAYOUT:-grid}"
+    echo "workload = ${BENCH_WORKLOAD:-mixed}"
+    echo "damage_rects = ${BENCH_DAMAGE_RECTS:-8}"
+    echo "streams = ${BENCH_STREAMS:-0}"
+    echo "frames = ${BENCH_FRAMES:-600}"
+    echo "warmup_frames = ${BENCH_WARMUP:-60}"
+
+    i=1
+    while [ "$i" -le "$outputs" ]; do
+        echo
+        echo "[HEADLESS-$i]"
+        echo "mode = $mode"
+        i=$((i + 1))
+    done
+} > "$config"
+
+if [ -z "$XDG_RUNTIME_DIR" ]; then
+    XDG_RUNTIME_DIR="$(mktemp -d "${TMPDIR:-/tmp}/wayfire-bench-runtime.XXXXXX")"
+    chmod 0700 "$XDG_RUNTIME_DIR"
+    export XDG_RUNTIME_DIR
+fi
+
+# Use the headless backend without any input devices. When there is no GPU
+# available, mesa falls back to software rendering on the surfaceless platform.
+export WLR_BACKENDS=headless
+export WLR_HEADLESS_OUTPUTS="$outputs"
+export WLR_LIBINPUT_NO_DEVICES=1
+export EGL_PLATFORM="${EGL_PLATFORM:-surfaceless}"
+
+"$wayfire" -c "$config"
@@ -76,9 +76,9 @@ wf_blur_base::~wf_blur_base()
     OpenGL::render_begin();
     fb[0].release();
     fb[1].release();
-    GL_CALL(glDeleteProgram(program[0]));
-    GL_CALL(glDeleteProgram(program[1]));
-    GL_CALL(glDeleteProgram(blend_program));
+    OpenGL::destroy_program(program[0]);
+    OpenGL::destroy_program(program[1]);
+    OpenGL::destroy_program(blend_program);
     OpenGL::render_end();
 }
 
@@ -106,7 +106,7 @@ void wf_blur_base::render_iteration(wf_framebuffer_base& in,
     out.allocate(width, height);
     out.bind();
 
-    GL_CALL(glBindTexture(GL_TEXTURE_2D, in.tex));
+    OpenGL::bind_texture(GL_TEXTURE_2D, in.tex);
     GL_CALL(glDrawArrays(GL_TRIANGLE_FAN, 0, 4));
 }
 
@@ -130,8 +130,8 @@ wlr_box wf_blur_base::copy_region(wf_framebuffer_base& result,
     OpenGL::render_begin(source);
     result.allocate(rounded_width, rounded_height);
 
-    GL_CALL(glBindFramebuffer(GL_READ_FRAMEBUFFER, source.fb));
-    GL_CALL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, result.fb));
+    OpenGL::bind_framebuffer(GL_READ_FRAMEBUFFER, source.fb);
+    OpenGL::bind_framebuffer(GL_DRAW_FRAMEBUFFER, result.fb);
     GL_CALL(glBlitFramebuffer(
             subbox.x, source_box.height - subbox.y - subbox.height,
             subbox.x + subbox.width, source_box.height - subbox.y,
@@ -164,7 +164,7 @@ void wf_blur_base::pre_render(uint32_t src_tex, wlr_box src_box,
         OpenGL::render_begin();
         fb[1].allocate(scaled_width, scaled_height);
         fb[1].bind();
-        GL_CALL(glBindFramebuffer(GL_READ_FRAMEBUFFER, fb[0].fb));
+        OpenGL::bind_framebuffer(GL_READ_FRAMEBUFFER, fb[0].fb);
         GL_CALL(glBlitFramebuffer(0, 0, rounded_width, rounded_height,
                 0, 0, scaled_width, scaled_height,
                 GL_COLOR_BUFFER_BIT, GL_LINEAR));
@@ -180,7 +180,7 @@ void wf_blur_base::pre_render(uint32_t src_tex, wlr_box src_box,
     OpenGL::render_begin();
     fb[1].allocate(view_box.width, view_box.height);
     fb[1].bind();
-    GL_CALL(glBindFramebuffer(GL_READ_FRAMEBUFFER, fb[0].fb));
+    OpenGL::bind_framebuffer(GL_READ_FRAMEBUFFER, fb[0].fb);
 
     /* Blit the blurred texture into an fb which has the size of the view,
      * so that the view texture and the blurred background can be combined
@@ -194,7 +194,7 @@ void wf_blur_base::pre_render(uint32_t src_tex, wlr_box src_box,
             local_box.x + local_box.width,
             view_box.height - local_box.y,
             GL_COLOR_BUFFER_BIT, GL_LINEAR));
-    GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+    OpenGL::bind_texture(GL_TEXTURE_2D, 0);
     OpenGL::render_end();
 }
 
@@ -209,7 +209,7 @@ void wf_blur_base::render(uint32_t src_tex, wlr_box src_box, wlr_box scissor_box
     OpenGL::render_begin(target_fb);
 
     /* Use shader and enable vertex and texcoord data */
-    GL_CALL(glUseProgram(blend_program));
+    OpenGL::use_program(blend_program);
     GL_CALL(glEnableVertexAttribArray(blend_posID));
     static const float vertexData[] = {
         -1.0f, -1.0f,
@@ -225,24 +225,24 @@ void wf_blur_base::render(uint32_t src_tex, wlr_box src_box, wlr_box scissor_box
     GL_CALL(glUniform1i(blend_texID[0], 0));
     GL_CALL(glUniform1i(blend_texID[1], 1));
 
-    GL_CALL(glActiveTexture(GL_TEXTURE0 + 0));
-    GL_CALL(glBindTexture(GL_TEXTURE_2D, src_tex));
-    GL_CALL(glActiveTexture(GL_TEXTURE0 + 1));
-    GL_CALL(glBindTexture(GL_TEXTURE_2D, fb[1].tex));
+    OpenGL::active_texture(GL_TEXTURE0 + 0);
+    OpenGL::bind_texture(GL_TEXTURE_2D, src_tex);
+    OpenGL::active_texture(GL_TEXTURE0 + 1);
+    OpenGL::bind_texture(GL_TEXTURE_2D, fb[1].tex);
     /* Render it to target_fb */
     target_fb.bind();
-    GL_CALL(glViewport(view_box.x, fb_geom.height - view_box.y - view_box.height,
-            view_box.width, view_box.height));
+    OpenGL::viewport(view_box.x, fb_geom.height - view_box.y - view_box.height,
+        view_box.width, view_box.height);
     target_fb.scissor(scissor_box);
 
     GL_CALL(glDrawArrays(GL_TRIANGLE_FAN, 0, 4));
 
     /* Disable stuff */
-    GL_CALL(glUseProgram(0));
+    OpenGL::use_program(0);
     /* GL_CALL(glActiveTexture(GL_TEXTURE0 + 1)); */
-    GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
-    GL_CALL(glActiveTexture(GL_TEXTURE0));
-    GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+    OpenGL::bind_texture(GL_TEXTURE_2D, 0);
+    OpenGL::active_texture(GL_TEXTURE0);
+    OpenGL::bind_texture(GL_TEXTURE_2D, 0);
     GL_CALL(glDisableVertexAttribArray(blend_posID));
 
     OpenGL::render_end();
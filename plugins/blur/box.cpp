@@ -112,7 +112,7 @@ class wf_box_blur : public wf_blur_base
             -1.0f,  1.0f
         };
 
-        GL_CALL(glUseProgram(program[i]));
+        OpenGL::use_program(program[i]);
         GL_CALL(glUniform2f(sizeID[i], width, height));
         GL_CALL(glUniform1f(offsetID[i], offset));
         GL_CALL(glVertexAttribPointer(posID[i], 2, GL_FLOAT, GL_FALSE, 0, vertexData));
@@ -120,7 +120,7 @@ class wf_box_blur : public wf_blur_base
 
     void blur(int i, int width, int height)
     {
-        GL_CALL(glUseProgram(program[i]));
+        OpenGL::use_program(program[i]);
         GL_CALL(glEnableVertexAttribArray(posID[i]));
         render_iteration(fb[i], fb[!i], width, height);
         GL_CALL(glDisableVertexAttribArray(posID[i]));
@@ -131,7 +131,7 @@ class wf_box_blur : public wf_blur_base
         int i, iterations = iterations_opt->as_cached_int();
 
         OpenGL::render_begin();
-        GL_CALL(glDisable(GL_BLEND));
+        OpenGL::disable(GL_BLEND);
         /* Enable our shader and pass some data to it. The shader
          * does box blur on the background texture in two passes,
          * one horizontal and one vertical */
@@ -147,11 +147,11 @@ class wf_box_blur : public wf_blur_base
         }
 
         /* Reset gl state */
-        GL_CALL(glEnable(GL_BLEND));
-        GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+        OpenGL::enable(GL_BLEND);
+        OpenGL::blend_func(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 
-        GL_CALL(glUseProgram(0));
-        GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+        OpenGL::use_program(0);
+        OpenGL::bind_texture(GL_TEXTURE_2D, 0);
         OpenGL::render_end();
 
         return 0;
@@ -103,7 +103,7 @@ class wf_kawase_blur : public wf_blur_base
         OpenGL::render_begin();
 
         /* Downsample */
-        GL_CALL(glUseProgram(program[0]));
+        OpenGL::use_program(program[0]);
         GL_CALL(glVertexAttribPointer(posID[0], 2, GL_FLOAT, GL_FALSE, 0, vertexData));
         GL_CALL(glEnableVertexAttribArray(posID[0]));
 
@@ -120,7 +120,7 @@ class wf_kawase_blur : public wf_blur_base
         GL_CALL(glDisableVertexAttribArray(posID[0]));
 
         /* Upsample */
-        GL_CALL(glUseProgram(program[1]));
+        OpenGL::use_program(program[1]);
         GL_CALL(glVertexAttribPointer(posID[1], 2, GL_FLOAT, GL_FALSE, 0, vertexData));
         GL_CALL(glEnableVertexAttribArray(posID[1]));
 
@@ -135,11 +135,11 @@ class wf_kawase_blur : public wf_blur_base
         }
 
         /* Reset gl state */
-        GL_CALL(glEnable(GL_BLEND));
-        GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+        OpenGL::enable(GL_BLEND);
+        OpenGL::blend_func(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 
-        GL_CALL(glUseProgram(0));
-        GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+        OpenGL::use_program(0);
+        OpenGL::bind_texture(GL_TEXTURE_2D, 0);
         GL_CALL(glDisableVertexAttribArray(posID[1]));
         OpenGL::render_end();
 
@@ -199,7 +199,7 @@ class wayfire_cube : public wf::plugin_interface_t
         }
 
         GL_CALL(glLinkProgram(program.id));
-        GL_CALL(glUseProgram(program.id));
+        OpenGL::use_program(program.id);
 
         GL_CALL(glDeleteShader(vss));
         GL_CALL(glDeleteShader(fss));
@@ -426,7 +426,7 @@ class wayfire_cube : public wf::plugin_interface_t
         for(size_t i = 0; i < streams.size(); i++)
         {
             int index = (cws.x + i) % streams.size();
-            GL_CALL(glBindTexture(GL_TEXTURE_2D, streams[index].buffer.tex));
+            OpenGL::bind_texture(GL_TEXTURE_2D, streams[index].buffer.tex);
 
             auto model = calculate_model_matrix(i, fb_transform);
             GL_CALL(glUniformMatrix4fv(program.modelID, 1, GL_FALSE, &model[0][0]));
@@ -468,8 +468,8 @@ class wayfire_cube : public wf::plugin_interface_t
         auto vp = calculate_vp_matrix(dest);
 
         OpenGL::render_begin(dest);
-        GL_CALL(glUseProgram(program.id));
-        GL_CALL(glEnable(GL_DEPTH_TEST));
+        OpenGL::use_program(program.id);
+        OpenGL::enable(GL_DEPTH_TEST);
         GL_CALL(glDepthFunc(GL_LESS));
 
         static GLfloat vertexData[] = {
@@ -505,13 +505,13 @@ class wayfire_cube : public wf::plugin_interface_t
          * By using two stages, we ensure that we first render the cube sides
          * that are on the back, and then we render those at the front, so we
          * don't have to use depth testing and we also can support alpha cube. */
-        GL_CALL(glEnable(GL_CULL_FACE));
+        OpenGL::enable(GL_CULL_FACE);
         render_cube(GL_CCW, dest.transform);
         render_cube(GL_CW, dest.transform);
-        GL_CALL(glDisable(GL_CULL_FACE));
+        OpenGL::disable(GL_CULL_FACE);
 
-        GL_CALL(glDisable(GL_DEPTH_TEST));
-        GL_CALL(glUseProgram(0));
+        OpenGL::disable(GL_DEPTH_TEST);
+        OpenGL::use_program(0);
         GL_CALL(glDisableVertexAttribArray(program.posID));
         GL_CALL(glDisableVertexAttribArray(program.uvID));
         OpenGL::render_end();
@@ -18,7 +18,7 @@ wf_cube_background_cubemap::wf_cube_background_cubemap()
 wf_cube_background_cubemap::~wf_cube_background_cubemap()
 {
     OpenGL::render_begin();
-    GL_CALL(glDeleteProgram(program));
+    OpenGL::destroy_program(program);
     OpenGL::render_end();
 }
 
@@ -49,7 +49,7 @@ void wf_cube_background_cubemap::reload_texture()
         GL_CALL(glGenTextures(1, &tex));
     }
 
-    GL_CALL(glBindTexture(GL_TEXTURE_CUBE_MAP, tex));
+    OpenGL::bind_texture(GL_TEXTURE_CUBE_MAP, tex);
     for (int i = 0; i < 6; i++)
     {
         if (!image_io::load_from_file(last_background_image, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i))
@@ -57,7 +57,7 @@ void wf_cube_background_cubemap::reload_texture()
             log_error("Failed to load cubemap background image from \"%s\".",
                 last_background_image.c_str());
 
-            GL_CALL(glDeleteTextures(1, &tex));
+            OpenGL::delete_texture(tex);
             tex = -1;
             break;
         }
@@ -72,7 +72,7 @@ void wf_cube_background_cubemap::reload_texture()
         GL_CALL(glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE));
     }
 
-    GL_CALL(glBindTexture(GL_TEXTURE_CUBE_MAP, 0));
+    OpenGL::bind_texture(GL_TEXTURE_CUBE_MAP, 0);
     OpenGL::render_end();
 }
 
@@ -91,10 +91,10 @@ void wf_cube_background_cubemap::render_frame(const wf_framebuffer& fb,
         return;
     }
 
-    GL_CALL(glUseProgram(program));
+    OpenGL::use_program(program);
     GL_CALL(glDepthMask(GL_FALSE));
 
-    GL_CALL(glBindTexture(GL_TEXTURE_CUBE_MAP, tex));
+    OpenGL::bind_texture(GL_TEXTURE_CUBE_MAP, tex);
 
     GL_CALL(glEnableVertexAttribArray(posID));
     GL_CALL(glVertexAttribPointer(posID, 3, GL_FLOAT, GL_FALSE, 0, skyboxVertices));
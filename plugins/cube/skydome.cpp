@@ -26,7 +26,7 @@ wf_cube_background_skydome::wf_cube_background_skydome(wf::output_t *output)
 wf_cube_background_skydome::~wf_cube_background_skydome()
 {
     OpenGL::render_begin();
-    GL_CALL(glDeleteProgram(program));
+    OpenGL::destroy_program(program);
     OpenGL::render_end();
 }
 
@@ -60,7 +60,7 @@ void wf_cube_background_skydome::reload_texture()
         GL_CALL(glGenTextures(1, &tex));
     }
 
-    GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
+    OpenGL::bind_texture(GL_TEXTURE_2D, tex);
 
     if (image_io::load_from_file(last_background_image, GL_TEXTURE_2D))
     {
@@ -73,11 +73,11 @@ void wf_cube_background_skydome::reload_texture()
     {
         log_error("Failed to load skydome image from \"%s\".",
             last_background_image.c_str());
-        GL_CALL(glDeleteTextures(1, &tex));
+        OpenGL::delete_texture(tex);
         tex = -1;
     }
 
-    GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+    OpenGL::bind_texture(GL_TEXTURE_2D, 0);
 
     OpenGL::render_end();
 }
@@ -151,7 +151,7 @@ void wf_cube_background_skydome::render_frame(const wf_framebuffer& fb,
 
     OpenGL::render_begin(fb);
 
-    GL_CALL(glUseProgram(program));
+    OpenGL::use_program(program);
 
     GL_CALL(glEnableVertexAttribArray(posID));
     GL_CALL(glEnableVertexAttribArray(uvID));
@@ -178,8 +178,8 @@ void wf_cube_background_skydome::render_frame(const wf_framebuffer& fb,
 
     GL_CALL(glUniformMatrix4fv(modelID, 1, GL_FALSE, &model[0][0]));
 
-    GL_CALL(glActiveTexture(GL_TEXTURE0));
-    GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
+    OpenGL::active_texture(GL_TEXTURE0);
+    OpenGL::bind_texture(GL_TEXTURE_2D, tex);
 
     GL_CALL(glDrawElements(GL_TRIANGLES,
             6 * SKYDOME_GRID_WIDTH * (SKYDOME_GRID_HEIGHT - 2),
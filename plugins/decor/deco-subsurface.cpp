@@ -57,7 +57,7 @@ GLuint get_text_texture(int width, int height,
 
     GLuint tex;
     GL_CALL(glGenTextures(1, &tex));
-    GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
+    OpenGL::bind_texture(GL_TEXTURE_2D, tex);
 
     GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
     GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
@@ -154,6 +154,8 @@ class simple_decoration_surface : public wf::surface_interface_t,
 
         wlr_render_quad_with_matrix(wf::get_core().renderer,
             active ? border_color : border_color_inactive, matrix);
+        /* wlroots changed the GL state */
+        OpenGL::invalidate_state();
 
         if (tex == (uint)-1)
         {
@@ -171,7 +173,7 @@ class simple_decoration_surface : public wf::surface_interface_t,
             fb.get_orthographic_projection(), {1, 1, 1, 1},
             TEXTURE_TRANSFORM_INVERT_Y);
 
-        GL_CALL(glUseProgram(0));
+        OpenGL::use_program(0);
         OpenGL::render_end();
     }
 
@@ -324,7 +326,7 @@ class simple_decoration_surface : public wf::surface_interface_t,
 
         if (tex != (uint32_t)-1)
         {
-            GL_CALL(glDeleteTextures(1, &tex));
+            OpenGL::delete_texture(tex);
         }
 
         tex = -1;
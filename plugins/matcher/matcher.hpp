@@ -41,6 +41,10 @@ namespace wf
         };
 
 #define WF_MATCHER_EVALUATE_SIGNAL "matcher-evaluate-match"
+        /* evaluate() is called often, so it emits by the interned name */
+        const signal_descriptor_t<match_evaluate_signal>
+            evaluate_signal{WF_MATCHER_EVALUATE_SIGNAL};
+
         bool evaluate(const std::unique_ptr<view_matcher>& matcher,
             wayfire_view view)
         {
@@ -49,7 +53,7 @@ namespace wf
             data.view = view;
             data.result = false; // by default
 
-            get_core().emit_signal(WF_MATCHER_EVALUATE_SIGNAL, &data);
+            get_core().emit_signal(evaluate_signal, &data);
             return data.result;
         }
     }
@@ -397,7 +397,7 @@ class wayfire_expo : public wf::plugin_interface_t
             }
         }
 
-        GL_CALL(glUseProgram(0));
+        OpenGL::use_program(0);
         OpenGL::render_end();
 
         update_zoom();
@@ -160,7 +160,7 @@ class vswipe : public wf::plugin_interface_t
                 out_geometry, {}, fb.transform * next * swipe);
         }
 
-        GL_CALL(glUseProgram(0));
+        OpenGL::use_program(0);
         OpenGL::render_end();
     }
 
@@ -89,8 +89,8 @@ class wayfire_zoom_screen : public wf::plugin_interface_t
             const float y1 = y * scale;
 
             OpenGL::render_begin(source);
-            GL_CALL(glBindFramebuffer(GL_READ_FRAMEBUFFER, source.fb));
-            GL_CALL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, destination.fb));
+            OpenGL::bind_framebuffer(GL_READ_FRAMEBUFFER, source.fb);
+            OpenGL::bind_framebuffer(GL_DRAW_FRAMEBUFFER, destination.fb);
             GL_CALL(glBlitFramebuffer(x1, y1, x1 + tw, y1 + th, 0, 0, w, h,
                     GL_COLOR_BUFFER_BIT, GL_LINEAR));
             OpenGL::render_end();
@@ -250,7 +250,7 @@ struct view_node_t::scale_transformer_t : public wf_2D_view
 view_node_t::view_node_t(wayfire_view view)
 {
     this->view = view;
-    view->store_data(std::make_unique<view_node_custom_data_t> (this));
+    view->store_slot_data(std::make_unique<view_node_custom_data_t> (this));
 
     this->on_geometry_changed = [=] (wf::signal_data_t*) {update_transformer(); };
     this->on_decoration_changed = [=] (wf::signal_data_t*) {
@@ -265,7 +265,7 @@ view_node_t::~view_node_t()
     view->pop_transformer(scale_transformer_name);
     view->disconnect_signal("geometry-changed", &on_geometry_changed);
     view->disconnect_signal("decoration-changed", &on_decoration_changed);
-    view->erase_data<view_node_custom_data_t>();
+    view->erase_slot_data<view_node_custom_data_t>();
 }
 
 wf_geometry view_node_t::calculate_target_geometry()
@@ -338,10 +338,11 @@ void view_node_t::update_transformer()
 
 nonstd::observer_ptr<view_node_t> view_node_t::get_node(wayfire_view view)
 {
-    if (!view->has_data<view_node_custom_data_t>())
+    auto data = view->get_slot_data<view_node_custom_data_t>();
+    if (!data)
         return nullptr;
 
-    return view->get_data<view_node_custom_data_t>()->ptr;
+    return data->ptr;
 }
 
 /* ----------------- Generic tree operations implementation ----------------- */
@@ -29,6 +29,10 @@ struct wobbly_signal : public _view_signal
     bool unanchor;
 };
 
+/* Emitted on the output of the view, for ex. on each pointer motion while the
+ * view is being moved */
+const wf::signal_descriptor_t<wobbly_signal> wobbly_event_signal{"wobbly-event"};
+
 inline void start_wobbly(wayfire_view view, int grab_x, int grab_y)
 {
     wobbly_signal sig;
@@ -37,7 +41,7 @@ inline void start_wobbly(wayfire_view view, int grab_x, int grab_y)
     sig.grab_x = grab_x;
     sig.grab_y = grab_y;
 
-    view->get_output()->emit_signal("wobbly-event", &sig);
+    view->get_output()->emit_signal(wobbly_event_signal, &sig);
 }
 
 inline void end_wobbly(wayfire_view view, bool unanchor = true)
@@ -46,7 +50,7 @@ inline void end_wobbly(wayfire_view view, bool unanchor = true)
     sig.view = view;
     sig.events = WOBBLY_EVENT_END;
     sig.unanchor = unanchor;
-    view->get_output()->emit_signal("wobbly-event", &sig);
+    view->get_output()->emit_signal(wobbly_event_signal, &sig);
 }
 
 inline void move_wobbly(wayfire_view view, int grab_x, int grab_y)
@@ -57,7 +61,7 @@ inline void move_wobbly(wayfire_view view, int grab_x, int grab_y)
     sig.geometry.x = grab_x;
     sig.geometry.y = grab_y;
 
-    view->get_output()->emit_signal("wobbly-event", &sig);
+    view->get_output()->emit_signal(wobbly_event_signal, &sig);
 }
 
 inline void snap_wobbly(wayfire_view view, wf_geometry geometry, bool snap = true)
@@ -67,7 +71,7 @@ inline void snap_wobbly(wayfire_view view, wf_geometry geometry, bool snap = tru
     sig.events = snap ? WOBBLY_EVENT_SNAP : WOBBLY_EVENT_UNSNAP;
     sig.geometry = geometry;
 
-    view->get_output()->emit_signal("wobbly-event", &sig);
+    view->get_output()->emit_signal(wobbly_event_signal, &sig);
 }
 
 inline void translate_wobbly(wayfire_view view, int dx, int dy)
@@ -78,6 +82,6 @@ inline void translate_wobbly(wayfire_view view, int dx, int dy)
     sig.geometry.x = dx;
     sig.geometry.y=  dy;
 
-    view->get_output()->emit_signal("wobbly-event", &sig);
+    view->get_output()->emit_signal(wobbly_event_signal, &sig);
 }
 #endif /* end of include guard: WOBBLY_SIGNAL_HPP */
@@ -40,49 +40,114 @@
 #define GRID_WIDTH  4
 #define GRID_HEIGHT 4
 
-#define MODEL_MAX_SPRINGS (GRID_WIDTH * GRID_HEIGHT * 2)
+#define GRID_OBJECTS (GRID_WIDTH * GRID_HEIGHT)
+
+/* The kernels below process 4 objects at once, and the Bezier patch in the
+ * vertex shader needs a 4x4 grid of control points */
+#if GRID_WIDTH != 4 || GRID_HEIGHT != 4
+#error "the wobbly model only supports a 4x4 grid"
+#endif
+
+/* Do not simulate more than this many steps in one frame, so that a long
+ * frame doesn't make the next one even longer */
+#define MAX_STEPS_PER_FRAME 8
 
 typedef struct _xy_pair {
     float x, y;
 } Point, Vector;
 
-typedef struct _Edge {
-    float next, prev;
+/* 4 floats, processed with SSE or NEON where available. Loads and stores go
+ * through memcpy, so the arrays don't need to be aligned. */
+typedef float Vec4 __attribute__ ((vector_size (16)));
+typedef int   Vec4i __attribute__ ((vector_size (16)));
+#define VEC_WIDTH 4
+
+static inline Vec4
+vecLoad (const float *p)
+{
+    Vec4 v;
+    memcpy (&v, p, sizeof (v));
+    return v;
+}
+
+static inline void
+vecStore (float *p, Vec4 v)
+{
+    memcpy (p, &v, sizeof (v));
+}
 
-    float start;
-    float end;
+static inline Vec4
+vecSplat (float f)
+{
+    Vec4 v = {f, f, f, f};
+    return v;
+}
 
-    float attract;
-    float velocity;
-} Edge;
+static inline Vec4
+vecAbs (Vec4 v)
+{
+    Vec4i mask = {INT_MAX, INT_MAX, INT_MAX, INT_MAX};
+    return (Vec4) ((Vec4i) v & mask);
+}
 
-typedef struct _Object {
-    Vector	 force;
-    Point	 position;
-    Vector	 velocity;
-    float	 theta;
-    int		 immobile;
-    Edge	 vertEdge;
-    Edge	 horzEdge;
-} Object;
+static inline float
+vecSum (Vec4 v)
+{
+    return v[0] + v[1] + v[2] + v[3];
+}
 
-typedef struct _Spring {
-    Object *a;
-    Object *b;
-    Vector offset;
-} Spring;
+/* The spring model is stored as a structure of arrays, with the objects of
+ * the grid in row-major order. Each object is connected with springs to the
+ * next object in its row and to the object below it. Since all springs in
+ * a row or column have the same length, the kernels in modelStep() work on
+ * 4 objects at once, by reading the arrays at the offset of the neighbor.
+ *
+ * The arrays are padded with GRID_WIDTH zeros for the reads past the last
+ * object. */
+#define OBJECTS_PADDED (GRID_OBJECTS + GRID_WIDTH)
 
 typedef struct _Model {
-    Object	 *objects;
-    int		 numObjects;
-    Spring	 springs[MODEL_MAX_SPRINGS];
-    int		 numSprings;
-    Object	 *anchorObject;
+    float	 positionX[OBJECTS_PADDED];
+    float	 positionY[OBJECTS_PADDED];
+    float	 velocityX[OBJECTS_PADDED];
+    float	 velocityY[OBJECTS_PADDED];
+    float	 forceX[OBJECTS_PADDED];
+    float	 forceY[OBJECTS_PADDED];
+    /* 0 for immobile objects, 1 for the others */
+    float	 mobile[OBJECTS_PADDED];
+
+    /* The rest length of the horizontal and the vertical springs */
+    float	 horzSpring, vertSpring;
+
+    /* The index of the anchor object, -1 if there is none */
+    int		 anchorObject;
     float	 steps;
+    /* Kinetic energy of the objects after the last step */
+    float	 energy;
     Point	 topLeft;
     Point	 bottomRight;
+
+    /* The control points of the rendered patch */
+    int		 meshValid;
+    float	 meshX[GRID_OBJECTS], meshY[GRID_OBJECTS];
 } Model;
 
+/* Masks out the springs which don't exist: the horizontal spring of the last
+ * object in each row, and the vertical springs of the last row */
+static const float horzSpringMask[GRID_OBJECTS] = {
+    1, 1, 1, 0,
+    1, 1, 1, 0,
+    1, 1, 1, 0,
+    1, 1, 1, 0,
+};
+
+static const float vertSpringMask[GRID_OBJECTS] = {
+    1, 1, 1, 1,
+    1, 1, 1, 1,
+    1, 1, 1, 1,
+    0, 0, 0, 0,
+};
+
 typedef struct _WobblyWindow {
     Model        *model;
     int          wobbly;
@@ -96,39 +161,23 @@ typedef struct _WobblyWindow {
 #define WobblyVelocity (1L << 2)
 
 static void
-objectInit (Object *object,
+objectInit (Model *model,
+	    int    object,
 	    float  positionX,
 	    float  positionY,
 	    float  velocityX,
 	    float  velocityY)
 {
-    object->force.x = 0;
-    object->force.y = 0;
-
-    object->position.x = positionX;
-    object->position.y = positionY;
+    model->forceX[object] = 0;
+    model->forceY[object] = 0;
 
-    object->velocity.x = velocityX;
-    object->velocity.y = velocityY;
+    model->positionX[object] = positionX;
+    model->positionY[object] = positionY;
 
-    object->theta    = 0;
-    object->immobile = 0;
-
-    object->vertEdge.next = 0.0f;
-    object->horzEdge.next = 0.0f;
-}
+    model->velocityX[object] = velocityX;
+    model->velocityY[object] = velocityY;
 
-static void
-springInit (Spring *spring,
-	    Object *a,
-	    Object *b,
-	    float  offsetX,
-	    float  offsetY)
-{
-    spring->a	     = a;
-    spring->b	     = b;
-    spring->offset.x = offsetX;
-    spring->offset.y = offsetY;
+    model->mobile[object] = 1;
 }
 
 static void
@@ -141,35 +190,20 @@ modelCalcBounds (Model *model)
     model->bottomRight.x = SHRT_MIN;
     model->bottomRight.y = SHRT_MIN;
 
-    for (i = 0; i < model->numObjects; i++)
+    for (i = 0; i < GRID_OBJECTS; i++)
     {
-	if (model->objects[i].position.x < model->topLeft.x)
-	    model->topLeft.x = model->objects[i].position.x;
-	else if (model->objects[i].position.x > model->bottomRight.x)
-	    model->bottomRight.x = model->objects[i].position.x;
-
-	if (model->objects[i].position.y < model->topLeft.y)
-	    model->topLeft.y = model->objects[i].position.y;
-	else if (model->objects[i].position.y > model->bottomRight.y)
-	    model->bottomRight.y = model->objects[i].position.y;
+	if (model->positionX[i] < model->topLeft.x)
+	    model->topLeft.x = model->positionX[i];
+	else if (model->positionX[i] > model->bottomRight.x)
+	    model->bottomRight.x = model->positionX[i];
+
+	if (model->positionY[i] < model->topLeft.y)
+	    model->topLeft.y = model->positionY[i];
+	else if (model->positionY[i] > model->bottomRight.y)
+	    model->bottomRight.y = model->positionY[i];
     }
 }
 
-static void
-modelAddSpring (Model  *model,
-		Object *a,
-		Object *b,
-		float  offsetX,
-		float  offsetY)
-{
-    Spring *spring;
-
-    spring = &model->springs[model->numSprings];
-    model->numSprings++;
-
-    springInit (spring, a, b, offsetX, offsetY);
-}
-
 static void
 modelSetMiddleAnchor (Model *model,
 		      int   x,
@@ -182,16 +216,15 @@ modelSetMiddleAnchor (Model *model,
     gx = ((GRID_WIDTH  - 1) / 2 * width)  / (float) (GRID_WIDTH  - 1);
     gy = ((GRID_HEIGHT - 1) / 2 * height) / (float) (GRID_HEIGHT - 1);
 
-    if (model->anchorObject)
-	model->anchorObject->immobile = 0;
+    if (model->anchorObject >= 0)
+	model->mobile[model->anchorObject] = 1;
 
-    model->anchorObject = &model->objects[GRID_WIDTH *
-					  ((GRID_HEIGHT - 1) / 2) +
-					  (GRID_WIDTH - 1) / 2];
-    model->anchorObject->position.x = x + gx;
-    model->anchorObject->position.y = y + gy;
+    model->anchorObject = GRID_WIDTH * ((GRID_HEIGHT - 1) / 2) +
+	(GRID_WIDTH - 1) / 2;
+    model->positionX[model->anchorObject] = x + gx;
+    model->positionY[model->anchorObject] = y + gy;
 
-    model->anchorObject->immobile = 1;
+    model->mobile[model->anchorObject] = 0;
 }
 
 static void
@@ -211,7 +244,7 @@ modelInitObjects (Model *model,
     {
 	for (gridX = 0; gridX < GRID_WIDTH; gridX++)
 	{
-	    objectInit (&model->objects[i],
+	    objectInit (model, i,
 			x + (gridX * width) / gw,
 			y + (gridY * height) / gh,
 			0, 0);
@@ -219,7 +252,7 @@ modelInitObjects (Model *model,
 	}
     }
 
-    if (!model->anchorObject)
+    if (model->anchorObject < 0)
         modelSetMiddleAnchor (model, x, y, width, height);
 }
 
@@ -228,33 +261,8 @@ modelInitSprings (Model *model,
 		  int   width,
 		  int   height)
 {
-    int   gridX, gridY, i = 0;
-    float hpad, vpad;
-
-    model->numSprings = 0;
-
-    hpad = ((float) width) / (GRID_WIDTH  - 1);
-    vpad = ((float) height) / (GRID_HEIGHT - 1);
-
-    for (gridY = 0; gridY < GRID_HEIGHT; gridY++)
-    {
-	for (gridX = 0; gridX < GRID_WIDTH; gridX++)
-	{
-	    if (gridX > 0)
-		modelAddSpring (model,
-				&model->objects[i - 1],
-				&model->objects[i],
-				hpad, 0);
-
-	    if (gridY > 0)
-		modelAddSpring (model,
-				&model->objects[i - GRID_WIDTH],
-				&model->objects[i],
-				0, vpad);
-
-	    i++;
-	}
-    }
+    model->horzSpring = ((float) width) / (GRID_WIDTH  - 1);
+    model->vertSpring = ((float) height) / (GRID_HEIGHT - 1);
 }
 
 static Model *
@@ -265,21 +273,12 @@ createModel (int	  x,
 {
     Model *model;
 
-    model = malloc (sizeof (Model));
+    /* The padding of the arrays has to be zero */
+    model = calloc (1, sizeof (Model));
     if (!model)
 	return 0;
 
-    model->numObjects = GRID_WIDTH * GRID_HEIGHT;
-    model->objects = malloc (sizeof (Object) * model->numObjects);
-    if (!model->objects)
-    {
-	free (model);
-	return 0;
-    }
-
-    model->anchorObject = 0;
-    model->numSprings = 0;
-
+    model->anchorObject = -1;
     model->steps = 0;
 
     modelInitObjects (model, x, y, width, height);
@@ -290,72 +289,99 @@ createModel (int	  x,
     return model;
 }
 
+/* Apply the forces of the springs between each object and the object offset
+ * objects after it. The spring pulls both objects so that the distance
+ * between them becomes (restX, restY). */
 static void
-objectApplyForce (Object *object,
-		  float  fx,
-		  float  fy)
+modelExertSpringForces (Model       *model,
+			int         offset,
+			float       restX,
+			float       restY,
+			const float *mask,
+			float       k)
 {
-    object->force.x += fx;
-    object->force.y += fy;
+    float da[2][GRID_OBJECTS];
+    Vec4  halfK = vecSplat (0.5f * k);
+    int   i;
+
+    /* Pull the first object of each spring, and remember the force */
+    for (i = 0; i < GRID_OBJECTS; i += VEC_WIDTH)
+    {
+	Vec4 m  = vecLoad (&mask[i]);
+	Vec4 dx = halfK * m * (vecLoad (&model->positionX[i + offset]) -
+			       vecLoad (&model->positionX[i]) - restX);
+	Vec4 dy = halfK * m * (vecLoad (&model->positionY[i + offset]) -
+			       vecLoad (&model->positionY[i]) - restY);
+
+	vecStore (&model->forceX[i], vecLoad (&model->forceX[i]) + dx);
+	vecStore (&model->forceY[i], vecLoad (&model->forceY[i]) + dy);
+	vecStore (&da[0][i], dx);
+	vecStore (&da[1][i], dy);
+    }
+
+    /* The second object is pulled in the opposite direction */
+    for (i = 0; i < GRID_OBJECTS; i += VEC_WIDTH)
+    {
+	vecStore (&model->forceX[i + offset],
+		  vecLoad (&model->forceX[i + offset]) - vecLoad (&da[0][i]));
+	vecStore (&model->forceY[i + offset],
+		  vecLoad (&model->forceY[i + offset]) - vecLoad (&da[1][i]));
+    }
 }
 
+/* Move the objects according to the forces on them, and return the sum of
+ * their velocities and of the forces */
 static void
-springExertForces (Spring *spring,
-		   float  k)
+modelStepObjects (Model *model,
+		  float friction,
+		  float *velocitySum,
+		  float *forceSum)
 {
-    Vector da, db;
-    Vector a, b;
-
-    a = spring->a->position;
-    b = spring->b->position;
-
-    da.x = 0.5f * (b.x - a.x - spring->offset.x);
-    da.y = 0.5f * (b.y - a.y - spring->offset.y);
+    Vec4 velocity = vecSplat (0), force = vecSplat (0);
+    int  i;
 
-    db.x = 0.5f * (a.x - b.x + spring->offset.x);
-    db.y = 0.5f * (a.y - b.y + spring->offset.y);
+    for (i = 0; i < GRID_OBJECTS; i += VEC_WIDTH)
+    {
+	Vec4 mobile = vecLoad (&model->mobile[i]);
+	Vec4 vx = vecLoad (&model->velocityX[i]);
+	Vec4 vy = vecLoad (&model->velocityY[i]);
+	Vec4 fx = vecLoad (&model->forceX[i]) - friction * vx;
+	Vec4 fy = vecLoad (&model->forceY[i]) - friction * vy;
+
+	/* Immobile objects have no velocity and no force */
+	vx = (vx + fx / (float) WOBBLY_MASS) * mobile;
+	vy = (vy + fy / (float) WOBBLY_MASS) * mobile;
+
+	vecStore (&model->velocityX[i], vx);
+	vecStore (&model->velocityY[i], vy);
+	vecStore (&model->positionX[i], vecLoad (&model->positionX[i]) + vx);
+	vecStore (&model->positionY[i], vecLoad (&model->positionY[i]) + vy);
+
+	vecStore (&model->forceX[i], vecSplat (0));
+	vecStore (&model->forceY[i], vecSplat (0));
+
+	velocity += vecAbs (vx) + vecAbs (vy);
+	force += (vecAbs (fx) + vecAbs (fy)) * mobile;
+    }
 
-    objectApplyForce (spring->a, k * da.x, k * da.y);
-    objectApplyForce (spring->b, k * db.x, k * db.y);
+    *velocitySum += vecSum (velocity);
+    *forceSum += vecSum (force);
 }
 
 static float
-modelStepObject ( Object	    *object,
-        float	    friction,
-        float	    *force)
+modelKineticEnergy (Model *model)
 {
-    object->theta += 0.05f;
+    Vec4 energy = vecSplat (0);
+    int  i;
 
-    if (object->immobile)
+    for (i = 0; i < GRID_OBJECTS; i += VEC_WIDTH)
     {
-	object->velocity.x = 0.0f;
-	object->velocity.y = 0.0f;
-
-	object->force.x = 0.0f;
-	object->force.y = 0.0f;
-
-	*force = 0.0f;
-
-	return 0.0f;
+	Vec4 vx = vecLoad (&model->velocityX[i]);
+	Vec4 vy = vecLoad (&model->velocityY[i]);
+	energy += vx * vx + vy * vy;
     }
-    else
-    {
-	object->force.x -= friction * object->velocity.x;
-	object->force.y -= friction * object->velocity.y;
-
-	object->velocity.x += object->force.x / WOBBLY_MASS;
-	object->velocity.y += object->force.y / WOBBLY_MASS;
-
-	object->position.x += object->velocity.x;
-	object->position.y += object->velocity.y;
 
-	*force = fabs (object->force.x) + fabs (object->force.y);
-
-	object->force.x = 0.0f;
-	object->force.y = 0.0f;
-
-	return fabs (object->velocity.x) + fabs (object->velocity.y);
-    }
+    return 0.5f * WOBBLY_MASS * vecSum (energy);
 }
 
 static int
@@ -364,9 +390,9 @@ modelStep (Model      *model,
 	   float      k,
 	   float      time)
 {
-    int   i, j, steps, wobbly = 0;
+    int   j, steps, wobbly = 0;
     float velocitySum = 0.0f;
-    float force, forceSum = 0.0f;
+    float forceSum = 0.0f;
 
     model->steps += time / 15.0f;
     steps = floor (model->steps);
@@ -375,21 +401,20 @@ modelStep (Model      *model,
     if (!steps)
 	return 1;
 
+    if (steps > MAX_STEPS_PER_FRAME)
+	steps = MAX_STEPS_PER_FRAME;
+
     for (j = 0; j < steps; j++)
     {
-	for (i = 0; i < model->numSprings; i++)
-	    springExertForces (&model->springs[i], k);
+	modelExertSpringForces (model, 1, model->horzSpring, 0,
+				horzSpringMask, k);
+	modelExertSpringForces (model, GRID_WIDTH, 0, model->vertSpring,
+				vertSpringMask, k);
 
-	for (i = 0; i < model->numObjects; i++)
-	{
-	    velocitySum += modelStepObject (
-					    &model->objects[i],
-					    friction,
-					    &force);
-	    forceSum += force;
-	}
+	modelStepObjects (model, friction, &velocitySum, &forceSum);
     }
 
+    model->energy = modelKineticEnergy (model);
     modelCalcBounds (model);
 
     if (velocitySum > 0.5f)
@@ -401,44 +426,6 @@ modelStep (Model      *model,
     return wobbly;
 }
 
-static void
-bezierPatchEvaluate (Model *model,
-		     float u,
-		     float v,
-		     float *patchX,
-		     float *patchY)
-{
-    float coeffsU[4], coeffsV[4];
-    float x, y;
-    int   i, j;
-
-    coeffsU[0] = (1 - u) * (1 - u) * (1 - u);
-    coeffsU[1] = 3 * u * (1 - u) * (1 - u);
-    coeffsU[2] = 3 * u * u * (1 - u);
-    coeffsU[3] = u * u * u;
-
-    coeffsV[0] = (1 - v) * (1 - v) * (1 - v);
-    coeffsV[1] = 3 * v * (1 - v) * (1 - v);
-    coeffsV[2] = 3 * v * v * (1 - v);
-    coeffsV[3] = v * v * v;
-
-    x = y = 0.0f;
-
-    for (i = 0; i < 4; i++)
-    {
-	for (j = 0; j < 4; j++)
-	{
-	    x += coeffsU[i] * coeffsV[j] *
-		model->objects[j * GRID_WIDTH + i].position.x;
-	    y += coeffsU[i] * coeffsV[j] *
-		model->objects[j * GRID_HEIGHT + i].position.y;
-	}
-    }
-
-    *patchX = x;
-    *patchY = y;
-}
-
 static int
 wobblyEnsureModel(struct wobbly_surface *surface)
 {
@@ -455,40 +442,53 @@ wobblyEnsureModel(struct wobbly_surface *surface)
 }
 
 static float
-objectDistance (Object *object,
-		float  x,
-		float  y)
+objectDistance (Model *model,
+		int   object,
+		float x,
+		float y)
 {
     float dx, dy;
 
-    dx = object->position.x - x;
-    dy = object->position.y - y;
+    dx = model->positionX[object] - x;
+    dy = model->positionY[object] - y;
 
     return sqrt (dx * dx + dy * dy);
 }
 
-static Object *
+static int
 modelFindNearestObject (Model *model,
 			float x,
 			float y)
 {
-    Object *object = &model->objects[0];
+    int    object = 0;
     float  distance, minDistance = 0.0;
     int    i;
 
-    for (i = 0; i < model->numObjects; i++)
+    for (i = 0; i < GRID_OBJECTS; i++)
     {
-	distance = objectDistance (&model->objects[i], x, y);
+	distance = objectDistance (model, i, x, y);
 	if (i == 0 || distance < minDistance)
 	{
 	    minDistance = distance;
-	    object = &model->objects[i];
+	    object = i;
 	}
     }
 
     return object;
 }
 
+static void
+modelSetObject (Model *model,
+		int   object,
+		float x,
+		float y,
+		int   immobile)
+{
+    model->positionX[object] = x;
+    model->positionY[object] = y;
+    model->mobile[object] = !immobile;
+}
+
 static void
 modelAdjustCorners (Model *model,
 		     int   x,
@@ -497,64 +497,35 @@ modelAdjustCorners (Model *model,
 		     int   height,
              int   make_immobile)
 {
-    Object *o;
-
-    o = &model->objects[0];
-    o->position.x = x;
-    o->position.y = y;
-    o->immobile = make_immobile;
-
-    o = &model->objects[GRID_WIDTH - 1];
-    o->position.x = x + width;
-    o->position.y = y;
-    o->immobile = make_immobile;
-
-    o = &model->objects[GRID_WIDTH * (GRID_HEIGHT - 1)];
-    o->position.x = x;
-    o->position.y = y + height;
-    o->immobile = make_immobile;
-
-    o = &model->objects[model->numObjects - 1];
-    o->position.x = x + width;
-    o->position.y = y + height;
-    o->immobile = make_immobile;
-
-    if (!model->anchorObject)
-	model->anchorObject = &model->objects[0];
+    modelSetObject (model, 0, x, y, make_immobile);
+    modelSetObject (model, GRID_WIDTH - 1, x + width, y, make_immobile);
+    modelSetObject (model, GRID_WIDTH * (GRID_HEIGHT - 1),
+		    x, y + height, make_immobile);
+    modelSetObject (model, GRID_OBJECTS - 1,
+		    x + width, y + height, make_immobile);
+
+    if (model->anchorObject < 0)
+	model->anchorObject = 0;
 }
 
 static int
 modelRemoveEdgeAnchors (Model *model)
 {
-    int result = 0;
-    Object *o;
-
-    o = &model->objects[0];
-    if (o != model->anchorObject)
-    {
-    result |= o->immobile;
-	o->immobile = 0;
-    }
-
-    o = &model->objects[GRID_WIDTH - 1];
-    if (o != model->anchorObject)
-    {
-    result |= o->immobile;
-	o->immobile = 0;
-    }
+    static const int corners[] = {
+	0, GRID_WIDTH - 1, GRID_WIDTH * (GRID_HEIGHT - 1), GRID_OBJECTS - 1
+    };
 
-    o = &model->objects[GRID_WIDTH * (GRID_HEIGHT - 1)];
-    if (o != model->anchorObject)
-    {
-    result |= o->immobile;
-	o->immobile = 0;
-    }
+    int result = 0;
+    int i;
 
-    o = &model->objects[model->numObjects - 1];
-    if (o != model->anchorObject)
+    for (i = 0; i < 4; i++)
     {
-    result |= o->immobile;
-	o->immobile = 0;
+	int o = corners[i];
+	if (o != model->anchorObject)
+	{
+	    result |= model->mobile[o] == 0;
+	    model->mobile[o] = 1;
+	}
     }
 
     return result;
@@ -604,48 +575,32 @@ void
 wobbly_add_geometry(struct wobbly_surface *surface)
 {
     WobblyWindow *ww = surface->ww;
-
-    float    width, height;
-    float    deformedX, deformedY;
-    int      x, y, iw, ih;
-    float    cell_w, cell_h;
-    GLfloat  *v, *uv;
+    Model *model = ww->model;
 
     if (ww->wobbly)
     {
-	width  = surface->width;
-	height = surface->height;
-
-	cell_w = width / surface->x_cells;
-	cell_h = height / surface->y_cells;
-
-        iw = surface->x_cells + 1;
-        ih = surface->y_cells + 1;
+	memcpy (model->meshX, model->positionX, sizeof (model->meshX));
+	memcpy (model->meshY, model->positionY, sizeof (model->meshY));
+	model->meshValid = 1;
+    }
+}
 
-	v = realloc(surface->v, sizeof(GLfloat) * 2 * iw * ih);
-	uv = realloc(surface->uv, sizeof(GLfloat) * 2 * iw * ih);
+int
+wobbly_get_control_points(struct wobbly_surface *surface, float *points)
+{
+    WobblyWindow *ww = surface->ww;
+    int i;
 
-	surface->v = v;
-	surface->uv = uv;
+    if (!ww->model || !ww->model->meshValid)
+	return 0;
 
-	for (y = 0; y < ih; y++)
-	{
-	    for (x = 0; x < iw; x++)
-	    {
-	        bezierPatchEvaluate (ww->model,
-	    			 (x * cell_w) / width,
-	    			 (y * cell_h) / height,
-	    			 &deformedX,
-	    			 &deformedY);
-
-	        *v++ = deformedX;
-	        *v++ = deformedY;
-
-	        *uv++ = (x * cell_w) / width;
-	        *uv++ = 1.0 - ((y * cell_h) / height);
-	    }
-	}
+    for (i = 0; i < GRID_OBJECTS; i++)
+    {
+	points[2 * i] = ww->model->meshX[i];
+	points[2 * i + 1] = ww->model->meshY[i];
     }
+
+    return 1;
 }
 
 void
@@ -666,8 +621,8 @@ wobbly_move_notify(struct wobbly_surface *surface, int dx, int dy)
     WobblyWindow *ww = surface->ww;
 
     if (ww->grabbed) {
-        ww->model->anchorObject->position.x += dx;
-        ww->model->anchorObject->position.y += dy;
+        ww->model->positionX[ww->model->anchorObject] += dx;
+        ww->model->positionY[ww->model->anchorObject] += dy;
 
         ww->wobbly |= WobblyInitial;
         surface->synced = 0;
@@ -681,32 +636,31 @@ wobbly_grab_notify(struct wobbly_surface *surface, int x, int y)
 
     if (wobblyEnsureModel (surface))
     {
-        Spring *s;
-        int	   i;
+        Model *model = ww->model;
+        int   anchor, gridX, gridY;
 
-        if (ww->model->anchorObject)
-            ww->model->anchorObject->immobile = 0;
+        if (model->anchorObject >= 0)
+            model->mobile[model->anchorObject] = 1;
 
-        ww->model->anchorObject = modelFindNearestObject (ww->model, x, y);
-        ww->model->anchorObject->immobile = 1;
+        anchor = modelFindNearestObject (model, x, y);
+        model->anchorObject = anchor;
+        model->mobile[anchor] = 0;
 
         ww->grabbed = 1;
 
-        for (i = 0; i < ww->model->numSprings; i++)
-        {
-            s = &ww->model->springs[i];
-
-            if (s->a == ww->model->anchorObject)
-            {
-                s->b->velocity.x -= s->offset.x * 0.05f;
-                s->b->velocity.y -= s->offset.y * 0.05f;
-            }
-            else if (s->b == ww->model->anchorObject)
-            {
-                s->a->velocity.x += s->offset.x * 0.05f;
-                s->a->velocity.y += s->offset.y * 0.05f;
-            }
-        }
+        /* Push the neighbors of the anchor towards it, along the springs
+         * between them */
+        gridX = anchor % GRID_WIDTH;
+        gridY = anchor / GRID_WIDTH;
+
+        if (gridX > 0)
+            model->velocityX[anchor - 1] += model->horzSpring * 0.05f;
+        if (gridX < GRID_WIDTH - 1)
+            model->velocityX[anchor + 1] -= model->horzSpring * 0.05f;
+        if (gridY > 0)
+            model->velocityY[anchor - GRID_WIDTH] += model->vertSpring * 0.05f;
+        if (gridY < GRID_HEIGHT - 1)
+            model->velocityY[anchor + GRID_WIDTH] -= model->vertSpring * 0.05f;
 
         ww->wobbly |= WobblyInitial;
     }
@@ -721,10 +675,10 @@ wobbly_ungrab_notify(struct wobbly_surface *surface)
     {
 	if (ww->model)
 	{
-	    if (ww->model->anchorObject)
-		ww->model->anchorObject->immobile = 0;
+	    if (ww->model->anchorObject >= 0)
+		ww->model->mobile[ww->model->anchorObject] = 1;
 
-	    ww->model->anchorObject = NULL;
+	    ww->model->anchorObject = -1;
 
 	    ww->wobbly |= WobblyInitial;
 	}
@@ -765,9 +719,7 @@ wobbly_fini(struct wobbly_surface *surface)
 
     if (ww->model)
     {
-	free(ww->model->objects);
 	free(ww->model);
-	free(surface->v);
     }
 
     free (ww);
@@ -779,10 +731,10 @@ void wobbly_force_geometry(struct wobbly_surface *surface, int x, int y, int w,
 
     if (wobblyEnsureModel(surface))
     {
-		if (!ww->grabbed && ww->model->anchorObject)
+		if (!ww->grabbed && ww->model->anchorObject >= 0)
 		{
-		    ww->model->anchorObject->immobile = 0;
-		    ww->model->anchorObject = NULL;
+		    ww->model->mobile[ww->model->anchorObject] = 1;
+		    ww->model->anchorObject = -1;
 		}
 
         surface->x = x;
@@ -819,10 +771,12 @@ void wobbly_translate(struct wobbly_surface *surface, int dx, int dy)
     WobblyWindow *ww = surface->ww;
     if (wobblyEnsureModel(surface))
     {
-        for (int i = 0; i < ww->model->numObjects; i++)
+        for (int i = 0; i < GRID_OBJECTS; i += VEC_WIDTH)
         {
-            ww->model->objects[i].position.x += dx;
-            ww->model->objects[i].position.y += dy;
+            vecStore (&ww->model->positionX[i],
+                      vecLoad (&ww->model->positionX[i]) + (float) dx);
+            vecStore (&ww->model->positionY[i],
+                      vecLoad (&ww->model->positionY[i]) + (float) dy);
         }
 
         ww->model->topLeft.x += dx;
@@ -832,6 +786,12 @@ void wobbly_translate(struct wobbly_surface *surface, int dx, int dy)
     }
 }
 
+float wobbly_kinetic_energy(struct wobbly_surface *surface)
+{
+    WobblyWindow *ww = surface->ww;
+    return ww->model ? ww->model->energy : 0;
+}
+
 struct wobbly_rect wobbly_boundingbox(struct wobbly_surface *surface)
 {
     WobblyWindow *ww = surface->ww;
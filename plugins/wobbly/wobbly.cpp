@@ -5,6 +5,8 @@
 #include <workspace-manager.hpp>
 #include <render-manager.hpp>
 
+#include <map>
+
 extern "C"
 {
 #include "wobbly.h"
@@ -16,16 +18,44 @@ namespace wobbly_graphics
 {
     namespace
     {
+        /* The view is rendered as a grid over the Bezier patch of the model.
+         * The grid is the same for all views with the same resolution, and
+         * only the control points change between frames. */
         const char* vertex_source = R"(
 #version 100
-attribute mediump vec2 position;
 attribute mediump vec2 uvPosition;
 varying highp vec2 uvpos;
 uniform mat4 MVP;
+/* 4x4 control points in row-major order */
+uniform vec2 control_points[16];
+
+vec4 bernstein(float t)
+{
+    float s = 1.0 - t;
+    return vec4(s * s * s, 3.0 * t * s * s, 3.0 * t * t * s, t * t * t);
+}
+
+vec2 blend_row(vec4 c, vec2 p0, vec2 p1, vec2 p2, vec2 p3)
+{
+    return c.x * p0 + c.y * p1 + c.z * p2 + c.w * p3;
+}
 
 void main() {
-    gl_Position = MVP * vec4(position.xy, 0.0, 1.0);
-    uvpos = uvPosition;
+    vec4 cu = bernstein(uvPosition.x);
+    vec4 cv = bernstein(uvPosition.y);
+
+    vec2 position =
+        cv.x * blend_row(cu, control_points[0], control_points[1],
+            control_points[2], control_points[3]) +
+        cv.y * blend_row(cu, control_points[4], control_points[5],
+            control_points[6], control_points[7]) +
+        cv.z * blend_row(cu, control_points[8], control_points[9],
+            control_points[10], control_points[11]) +
+        cv.w * blend_row(cu, control_points[12], control_points[13],
+            control_points[14], control_points[15]);
+
+    gl_Position = MVP * vec4(position, 0.0, 1.0);
+    uvpos = vec2(uvPosition.x, 1.0 - uvPosition.y);
 }
 )";
 
@@ -41,7 +71,20 @@ void main()
 )";
     }
 
-    GLuint program, uvID, posID, mvpID;
+    GLuint program, uvID, mvpID, controlPointsID;
+
+    /* The grid for each resolution in use. With adaptive resolution, views
+     * can be rendered with different ones in the same frame. */
+    struct grid_t
+    {
+        /* The position of each grid point in the patch, from (0, 0) to
+         * (1, 1). The vertex array also holds the index buffer. */
+        wf_gpu_buffer vertices{GL_ARRAY_BUFFER, WF_BUFFER_PERSISTENT};
+        wf_gpu_buffer indices{GL_ELEMENT_ARRAY_BUFFER, WF_BUFFER_PERSISTENT};
+        int count = 0;
+    };
+
+    std::map<int, grid_t> grids;
 
     int times_loaded = 0;
 
@@ -53,8 +96,9 @@ void main()
         OpenGL::render_begin();
         program = OpenGL::create_program_from_source(vertex_source, frag_source);
         uvID  = GL_CALL(glGetAttribLocation(program, "uvPosition"));
-        posID = GL_CALL(glGetAttribLocation(program, "position"));
         mvpID = GL_CALL(glGetUniformLocation(program, "MVP"));
+        controlPointsID =
+            GL_CALL(glGetUniformLocation(program, "control_points"));
         OpenGL::render_end();
     }
 
@@ -63,44 +107,107 @@ void main()
         if (--times_loaded == 0)
         {
             OpenGL::render_begin();
-            GL_CALL(glDeleteProgram(program));
+            OpenGL::destroy_program(program);
+            for (auto& grid : grids)
+            {
+                grid.second.vertices.release();
+                grid.second.indices.release();
+            }
+
+            grids.clear();
             OpenGL::render_end();
         }
     }
 
-    /* Requires bound opengl context */
-    void render_triangles(GLuint tex, glm::mat4 mat, float *pos, float *uv, int cnt)
+    /* Get the grid with resolution x resolution cells */
+    grid_t& get_grid(int resolution)
+    {
+        auto& grid = grids[resolution];
+        if (grid.count > 0)
+            return grid;
+
+        std::vector<GLfloat> points;
+        int per_row = resolution + 1;
+        for (int y = 0; y < per_row; y++)
+        {
+            for (int x = 0; x < per_row; x++)
+            {
+                points.push_back(1.0f * x / resolution);
+                points.push_back(1.0f * y / resolution);
+            }
+        }
+
+        std::vector<GLuint> idx;
+        for (int j = 0; j < resolution; j++)
+        {
+            for (int i = 0; i < resolution; i++)
+            {
+                idx.push_back(i * per_row + j);
+                idx.push_back((i + 1) * per_row + j + 1);
+                idx.push_back(i * per_row + j + 1);
+
+                idx.push_back(i * per_row + j);
+                idx.push_back((i + 1) * per_row + j);
+                idx.push_back((i + 1) * per_row + j + 1);
+            }
+        }
+
+        grid.vertices.upload(points.data(), points.size() * sizeof(GLfloat));
+        grid.vertices.bind();
+        grid.indices.upload(idx.data(), idx.size() * sizeof(GLuint));
+        grid.vertices.set_attribute(uvID, 2, 0, 0);
+
+        /* Unbind the vertex array first, so that it keeps the indices */
+        grid.vertices.unbind();
+        grid.indices.unbind();
+        grid.count = idx.size();
+
+        return grid;
+    }
+
+    /* Requires bound opengl context
+     *
+     * @param control_points The 4x4 control points of the patch, as x, y
+     *        pairs in row-major order
+     * @param scissors The boxes on the framebuffer to render */
+    void render_grid(GLuint tex, glm::mat4 mat, const GLfloat *control_points,
+        int resolution, const wf_framebuffer& fb,
+        const std::vector<wlr_box>& scissors)
     {
-        GL_CALL(glUseProgram(program));
+        OpenGL::use_program(program);
         GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
         GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
 
         GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
         GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
-        GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
-        GL_CALL(glActiveTexture(GL_TEXTURE0));
+        OpenGL::active_texture(GL_TEXTURE0);
+        OpenGL::bind_texture(GL_TEXTURE_2D, tex);
 
-        GL_CALL(glVertexAttribPointer(posID, 2, GL_FLOAT, GL_FALSE, 0, pos));
-        GL_CALL(glEnableVertexAttribArray(posID));
-
-        GL_CALL(glVertexAttribPointer(uvID, 2, GL_FLOAT, GL_FALSE, 0, uv));
-        GL_CALL(glEnableVertexAttribArray(uvID));
+        auto& grid = get_grid(resolution);
+        grid.vertices.bind();
 
         GL_CALL(glUniformMatrix4fv(mvpID, 1, GL_FALSE, &mat[0][0]));
-        GL_CALL(glEnable(GL_BLEND));
-        GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+        GL_CALL(glUniform2fv(controlPointsID, 16, control_points));
+        OpenGL::enable(GL_BLEND);
+        OpenGL::blend_func(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 
-        GL_CALL(glDrawArrays (GL_TRIANGLES, 0, 3 * cnt));
-        GL_CALL(glDisable(GL_BLEND));
+        /* The grid is static, and just the scissor box changes between
+         * draws */
+        for (auto& box : scissors)
+        {
+            fb.scissor(box);
+            GL_CALL(glDrawElements(GL_TRIANGLES, grid.count,
+                    GL_UNSIGNED_INT, 0));
+        }
 
-        GL_CALL(glDisableVertexAttribArray(uvID));
-        GL_CALL(glDisableVertexAttribArray(posID));
+        OpenGL::disable(GL_BLEND);
+        grid.vertices.unbind();
     }
 };
 
 namespace wobbly_settings
 {
-    wf_option friction, spring_k, resolution;
+    wf_option friction, spring_k, resolution, adaptive_resolution;
 
     void init(wayfire_config *config)
     {
@@ -108,6 +215,8 @@ namespace wobbly_settings
         friction = section->get_option("friction", "3");
         spring_k = section->get_option("spring_k", "8");
         resolution = section->get_option("grid_resolution", "6");
+        adaptive_resolution =
+            section->get_option("adaptive_resolution", "0");
     };
 };
 
@@ -143,6 +252,9 @@ class wf_wobbly : public wf_view_transformer_t
 
     int grab_x = 0, grab_y = 0;
 
+    /* The number of cells in each direction of the rendered grid */
+    int grid_resolution;
+
     wf_geometry snapped_geometry;
     uint32_t last_frame;
 
@@ -162,11 +274,7 @@ class wf_wobbly : public wf_view_transformer_t
         model->grabbed = 0;
         model->synced = 1;
 
-        model->x_cells = wobbly_settings::resolution->as_cached_int();
-        model->y_cells = wobbly_settings::resolution->as_cached_int();
-
-        model->v = NULL;
-        model->uv = NULL;
+        grid_resolution = wobbly_settings::resolution->as_cached_int();
 
         last_frame = get_current_time();
         wobbly_init(model.get());
@@ -224,6 +332,23 @@ class wf_wobbly : public wf_view_transformer_t
         return point;
     }
 
+    /* With adaptive resolution, the grid has fewer cells while the model
+     * moves slowly, because the patch is then close to a rectangle */
+    int get_grid_resolution()
+    {
+        int resolution = wobbly_settings::resolution->as_cached_int();
+        if (!wobbly_settings::adaptive_resolution->as_cached_int())
+            return resolution;
+
+        /* The energy of the model when all of its points move by 2 pixels
+         * per step. The full resolution is used from there on. */
+        const float full_energy = 0.5 * WOBBLY_MASS * 16 * 2 * 2;
+        float energy = wobbly_kinetic_energy(model.get());
+
+        int cells = std::ceil(resolution * std::sqrt(energy / full_energy));
+        return clamp(cells, std::min(resolution, 2), resolution);
+    }
+
     void update_model()
     {
         view->damage();
@@ -243,6 +368,7 @@ class wf_wobbly : public wf_view_transformer_t
         wobbly_prepare_paint(model.get(), now - last_frame);
         last_frame = now;
 
+        grid_resolution = get_grid_resolution();
         wobbly_add_geometry(model.get());
         wobbly_done_paint(model.get());
 
@@ -268,62 +394,46 @@ class wf_wobbly : public wf_view_transformer_t
     virtual void render_box(uint32_t src_tex, wlr_box src_box,
         wlr_box scissor_box, const wf_framebuffer& target_fb)
     {
-        OpenGL::render_begin(target_fb);
-        target_fb.scissor(scissor_box);
-
-        float x = src_box.x, y = src_box.y, w = src_box.width, h = src_box.height;
-
-        std::vector<float> vert, uv;
-        std::vector<int> idx;
-
-        int per_row = model->x_cells + 1;
+        render_boxes(src_tex, src_box, {scissor_box}, target_fb);
+    }
 
-        for (int j = 0; j < model->y_cells; j++)
+    virtual void render_with_damage(uint32_t src_tex, wlr_box src_box,
+        const wf_region& damage, const wf_framebuffer& target_fb)
+    {
+        std::vector<wlr_box> boxes;
+        for (const auto& rect : damage)
         {
-            for (int i = 0; i < model->x_cells; i++)
-            {
-                idx.push_back(i * per_row + j);
-                idx.push_back((i + 1) * per_row + j + 1);
-                idx.push_back(i * per_row + j + 1);
-
-                idx.push_back(i * per_row + j);
-                idx.push_back((i + 1) * per_row + j);
-                idx.push_back((i + 1) * per_row + j + 1);
-            }
+            boxes.push_back(target_fb.framebuffer_box_from_damage_box(
+                    wlr_box_from_pixman_box(rect)));
         }
 
-        if (!model->v || !model->uv)
-        {
-            for (auto id : idx)
-            {
-                float tile_w = w / model->x_cells;
-                float tile_h = h / model->y_cells;
-
-                int i = id / per_row;
-                int j = id % per_row;
+        render_boxes(src_tex, src_box, boxes, target_fb);
+    }
 
-                vert.push_back(i * tile_w + x);
-                vert.push_back(j * tile_h + y);
+    void render_boxes(uint32_t src_tex, wlr_box src_box,
+        const std::vector<wlr_box>& scissor_boxes, const wf_framebuffer& target_fb)
+    {
+        float x = src_box.x, y = src_box.y, w = src_box.width, h = src_box.height;
 
-                uv.push_back(1.0f * i / model->x_cells);
-                uv.push_back(1.0f - 1.0f * j / model->y_cells);
-            }
-        } else
+        GLfloat control_points[32];
+        if (!wobbly_get_control_points(model.get(), control_points))
         {
-            for (auto i : idx)
+            /* The model hasn't moved yet, so render the view as it is. Evenly
+             * spaced control points make a flat patch. */
+            for (int j = 0; j < 4; j++)
             {
-                vert.push_back(model->v[2 * i]);
-                vert.push_back(model->v[2 * i + 1]);
-
-                uv.push_back(model->uv[2 * i]);
-                uv.push_back(model->uv[2 * i + 1]);
+                for (int i = 0; i < 4; i++)
+                {
+                    control_points[2 * (4 * j + i)] = x + w * i / 3;
+                    control_points[2 * (4 * j + i) + 1] = y + h * j / 3;
+                }
             }
         }
 
-        wobbly_graphics::render_triangles(src_tex,
-            target_fb.get_orthographic_projection(),
-            vert.data(), uv.data(), model->x_cells * model->y_cells * 2);
-
+        OpenGL::render_begin(target_fb);
+        wobbly_graphics::render_grid(src_tex,
+            target_fb.get_orthographic_projection(), control_points,
+            grid_resolution, target_fb, scissor_boxes);
         OpenGL::render_end();
     }
 
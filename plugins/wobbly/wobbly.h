@@ -7,8 +7,6 @@
 
 #include <stdio.h>
 
-#include <GLES2/gl2.h>
-
 #define MINIMAL_FRICTION 0.1
 #define MAXIMAL_FRICTION 10.0
 #define MINIMAL_SPRING_K 0.1
@@ -22,11 +20,7 @@ struct wobbly_surface
 {
    void *ww;
    int x, y, width, height;
-   int x_cells, y_cells;
    int grabbed, synced;
-   int vertex_count;
-
-   GLfloat *v, *uv;
 };
 
 struct wobbly_rect
@@ -43,8 +37,14 @@ void wobbly_resize_notify(struct wobbly_surface *surface);
 void wobbly_move_notify(struct wobbly_surface *surface, int dx, int dy);
 void wobbly_prepare_paint(struct wobbly_surface *surface, int msSinceLastPaint);
 void wobbly_done_paint(struct wobbly_surface *surface);
+/* Update the control points returned by wobbly_get_control_points() */
 void wobbly_add_geometry(struct wobbly_surface *surface);
+/* Store the 4x4 control points of the Bezier patch in points, as 16 x, y
+ * pairs in row-major order. Returns 0 if the patch hasn't been updated yet */
+int  wobbly_get_control_points(struct wobbly_surface *surface, float *points);
 struct wobbly_rect wobbly_boundingbox(struct wobbly_surface *surface);
+/* The kinetic energy of the model after the last step */
+float wobbly_kinetic_energy(struct wobbly_surface *surface);
 
 void wobbly_force_geometry(struct wobbly_surface *surface, int x, int y, int w, int h);
 void wobbly_unenforce_geometry(struct wobbly_surface *surface);
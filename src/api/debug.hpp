@@ -5,6 +5,8 @@
 #include "config.h"
 #endif
 
+#include <cstdint>
+
 extern "C"
 {
 #include  <wlr/util/log.h>
@@ -26,4 +28,15 @@ const char *wf_strip_path(const char *path);
 #define nonull(x) ((x) ? (x) : ("nil"))
 
 void wf_print_trace();
+
+/* The number of heap allocations made with operator new by the calling thread.
+ * Allocations are only counted in debug builds, otherwise this is always 0. */
+uint64_t wf_get_allocation_count();
+
+/* Caches which keep their storage between frames, like the flattened surface
+ * lists and the workspace index, call this when their storage grows. The
+ * render manager uses it to tell their first-time growth apart from
+ * allocations in a steady-state frame. Only counted in debug builds. */
+void wf_note_cache_growth();
+uint64_t wf_get_cache_growth_count();
 #endif
@@ -2,10 +2,12 @@
 #define OBJECT_HPP
 
 #include <typeinfo>
+#include <functional>
 #include <memory>
 #include <string>
 
 #include <nonstd/observer_ptr.h>
+#include <nonstd/noncopyable.hpp>
 
 namespace wf
 {
@@ -19,15 +21,143 @@ struct signal_data_t
 };
 using signal_callback_t = std::function<void(signal_data_t*)>;
 
+/** The ID of an interned signal name, see intern_signal() */
+using signal_id_t = uint32_t;
+
+/**
+ * Get the ID of the signal with the given name. Names are interned the first
+ * time they are used and keep their ID until Wayfire exits, so signals can be
+ * connected and emitted by ID without hashing the name each time.
+ */
+signal_id_t intern_signal(const std::string& name);
+
+/**
+ * Describes a signal with its interned name and the type of its data.
+ *
+ * Descriptors are meant to be constants, declared next to the data type of
+ * the signal, for ex. wf::signals::geometry_changed. The name is interned
+ * once, when the descriptor is created, and emitting or connecting with the
+ * wrong data type doesn't compile.
+ */
+template<class DataT>
+class signal_descriptor_t
+{
+  public:
+    using data_t = DataT;
+
+    explicit signal_descriptor_t(const char *name)
+        : id(intern_signal(name)) { }
+
+    signal_id_t get_id() const
+    {
+        return id;
+    }
+
+  private:
+    signal_id_t id;
+};
+
+class signal_provider_t;
+
+/**
+ * A connection of a callback to a signal of a signal provider, see
+ * signal_connection_t.
+ *
+ * Connections disconnect themselves when they are destroyed, and are
+ * disconnected automatically if the provider is destroyed first.
+ */
+class signal_connection_base_t : public noncopyable_t
+{
+  public:
+    /** Disconnect from the signal, if connected */
+    void disconnect();
+
+    /** @return true if the connection is connected to a signal */
+    bool is_connected() const
+    {
+        return provider != nullptr;
+    }
+
+    virtual ~signal_connection_base_t();
+
+  protected:
+    signal_connection_base_t() = default;
+
+    /* The callback registered in the provider */
+    signal_callback_t dispatch;
+
+  private:
+    friend class signal_provider_t;
+    signal_provider_t *provider = nullptr;
+    signal_id_t id = 0;
+};
+
+/**
+ * A connection of a callback which receives the data of a signal with its
+ * actual type. Connect it with signal_provider_t::connect_signal() and a
+ * signal descriptor.
+ */
+template<class DataT>
+class signal_connection_t : public signal_connection_base_t
+{
+  public:
+    using callback_t = std::function<void(DataT*)>;
+
+    signal_connection_t()
+    {
+        dispatch = [=] (signal_data_t *data)
+        {
+            if (callback)
+                callback(static_cast<DataT*> (data));
+        };
+    }
+
+    signal_connection_t(callback_t callback) : signal_connection_t()
+    {
+        set_callback(callback);
+    }
+
+    void set_callback(callback_t callback)
+    {
+        this->callback = callback;
+    }
+
+  private:
+    callback_t callback;
+};
+
 class signal_provider_t
 {
   public:
     /** Register a callback to be called whenever the given signal is emitted */
-    void connect_signal(std::string name, signal_callback_t* callback);
+    void connect_signal(signal_id_t id, signal_callback_t* callback);
     /** Unregister a registered callback */
-    void disconnect_signal(std::string name, signal_callback_t* callback);
+    void disconnect_signal(signal_id_t id, signal_callback_t* callback);
     /** Emit the given signal. No type checking for data is required */
-    void emit_signal(std::string name, signal_data_t *data);
+    void emit_signal(signal_id_t id, signal_data_t *data);
+
+    /** Connect the connection to the given signal. If it was connected to
+     * another signal, it is disconnected from it first. */
+    template<class DataT>
+    void connect_signal(const signal_descriptor_t<DataT>& signal,
+        signal_connection_t<DataT> *connection)
+    {
+        connect_connection(signal.get_id(), connection);
+    }
+
+    /** Emit the given signal with data of the type of the signal */
+    template<class DataT>
+    void emit_signal(const signal_descriptor_t<DataT>& signal,
+        typename signal_descriptor_t<DataT>::data_t *data)
+    {
+        emit_signal(signal.get_id(), data);
+    }
+
+    /* The functions below are the same as the ones above, but look up the
+     * signal by name, which needs to hash the name on each call */
+    void connect_signal(const std::string& name, signal_callback_t* callback);
+    void disconnect_signal(const std::string& name, signal_callback_t* callback);
+    void emit_signal(const std::string& name, signal_data_t *data);
 
     virtual ~signal_provider_t();
 
@@ -35,6 +165,11 @@ class signal_provider_t
     signal_provider_t();
 
   private:
+    friend class signal_connection_base_t;
+    void connect_connection(signal_id_t id,
+        signal_connection_base_t *connection);
+    void disconnect_connection(signal_connection_base_t *connection);
+
     class sprovider_impl;
     std::unique_ptr<sprovider_impl> sprovider_priv;
 };
@@ -48,6 +183,32 @@ class custom_data_t
     virtual ~custom_data_t() {};
 };
 
+/**
+ * Get the index of the custom data slot for the type with the given mangled
+ * name. Each type gets its index the first time it is registered, and keeps
+ * it until Wayfire exits. Types in anonymous namespaces get a new index on
+ * each registration. Plugins should use custom_data_slot<T>() instead.
+ */
+uint32_t register_custom_data_slot(const std::string& type_name);
+
+/**
+ * @return The index of the custom data slot of the type T. The type is
+ * registered once, on the first call. Registration goes by the name of the
+ * type, so core and all plugins get the same index for the same type.
+ *
+ * This means that different types stored in slots must have different fully
+ * qualified names. Plugins should declare their custom data types in an
+ * anonymous namespace or in a namespace of their own, instead of the global
+ * one, where another plugin may use the same name. All types in anonymous
+ * namespaces have the same prefix in their name, so they get a slot of their
+ * own instead.
+ */
+template<class T> uint32_t custom_data_slot()
+{
+    static const uint32_t slot = register_custom_data_slot(typeid(T).name());
+    return slot;
+}
+
 /**
  * A base class for "objects". Objects provide signals and ways for plugins to
  * store custom data about the object.
@@ -124,12 +285,71 @@ class object_base_t : public signal_provider_t
         return std::unique_ptr<T> (dynamic_cast<T*>(stored));
     }
 
+    /**
+     * Retrieve the data of type T stored in the slot of T. If no such data
+     * exists, then it is created with the default constructor.
+     *
+     * Slot data is kept in a small array in each object, indexed by
+     * custom_data_slot<T>(), so the lookup doesn't hash any name or use
+     * dynamic_cast. It is separate from the data stored by name, and should
+     * be preferred for data which is looked up often.
+     *
+     * REQUIRES a default constructor
+     * If your type doesn't have one, use store_slot_data + get_slot_data
+     */
+    template<class T> nonstd::observer_ptr<T> get_slot_data_safe()
+    {
+        uint32_t slot = custom_data_slot<T>();
+        auto data = _fetch_slot(slot, typeid(T).name());
+        if (!data)
+        {
+            auto created = std::make_unique<T>();
+            data = created.get();
+            _store_slot(slot, std::move(created));
+        }
+
+        return nonstd::make_observer(static_cast<T*> (data));
+    }
+
+    /** Retrieve the data stored in the slot of T. If no such data exists,
+     * NULL is returned */
+    template<class T> nonstd::observer_ptr<T> get_slot_data()
+    {
+        return nonstd::make_observer(
+            static_cast<T*> (_fetch_slot(custom_data_slot<T>(),
+                typeid(T).name())));
+    }
+
+    /** Store the given data in the slot of T, replacing the old data */
+    template<class T> void store_slot_data(std::unique_ptr<T> stored_data)
+    {
+        _store_slot(custom_data_slot<T>(), std::move(stored_data));
+    }
+
+    /** @return true if there is data stored in the slot of T */
+    template<class T> bool has_slot_data()
+    {
+        return _fetch_slot(custom_data_slot<T>(), typeid(T).name()) != nullptr;
+    }
+
+    /** Remove the data stored in the slot of T */
+    template<class T> void erase_slot_data()
+    {
+        _store_slot(custom_data_slot<T>(), nullptr);
+    }
+
     virtual ~object_base_t();
 
   protected:
     object_base_t();
 
   private:
+    /** Get the data in the given slot, or NULL if the slot is empty. In debug
+     * builds, checks that the slot was registered for the given type name */
+    custom_data_t *_fetch_slot(uint32_t slot, const char *type_name);
+    /** Replace the data in the given slot */
+    void _store_slot(uint32_t slot, std::unique_ptr<custom_data_t> data);
+
     /** Just get the data under the given name */
     custom_data_t *_fetch_data(std::string name);
     /** Get the data under the given name, and release the pointer, deleting
@@ -3,11 +3,16 @@
 
 #include <GLES3/gl3.h>
 
+#ifndef WAYFIRE_PLUGIN
+#include "config.h"
+#endif
+
 #include <config.hpp>
 #include <util.hpp>
 #include <nonstd/noncopyable.hpp>
 
 #include <geometry.hpp>
+#include <vector>
 
 #define GLM_FORCE_RADIANS
 #include <glm/mat4x4.hpp>
@@ -19,9 +24,25 @@ void gl_call(const char*, uint32_t, const char*);
 #  define __STRING(x) #x
 #endif
 
+/* The most thorough GL error checking which can be enabled at runtime with
+ * the core/gl_error_checks option, selected at build time */
+#define WF_GL_ERROR_CHECKS_OFF      0
+#define WF_GL_ERROR_CHECKS_CALLBACK 1
+#define WF_GL_ERROR_CHECKS_SYNC     2
+
+/* Plugins built outside of the tree support all modes */
+#ifndef WAYFIRE_GL_ERROR_CHECKS
+#define WAYFIRE_GL_ERROR_CHECKS WF_GL_ERROR_CHECKS_SYNC
+#endif
+
 /* recommended to use this to make OpenGL calls, since it offers easier debugging */
 /* This macro is taken from WLC source code */
+#if WAYFIRE_GL_ERROR_CHECKS >= WF_GL_ERROR_CHECKS_SYNC
+/* gl_call() returns immediately unless sync checks are enabled at runtime */
 #define GL_CALL(x) x; gl_call(__PRETTY_FUNCTION__, __LINE__, __STRING(x))
+#else
+#define GL_CALL(x) x
+#endif
 
 #define TEXTURE_TRANSFORM_INVERT_X     (1 << 0)
 #define TEXTURE_TRANSFORM_INVERT_Y     (1 << 1)
@@ -49,7 +70,8 @@ struct wf_framebuffer_base : public noncopyable_t
      * OpenGL::render_begin() and OpenGL::render_end() */
 
     /* will invalidate texture contents if width or height changes.
-     * If tex and/or fb haven't been set, it creates them
+     * If tex and/or fb haven't been set, it creates them, or takes a buffer
+     * with the same size from the framebuffer pool
      * Return true if texture was created/invalidated */
     bool allocate(int width, int height);
 
@@ -60,8 +82,9 @@ struct wf_framebuffer_base : public noncopyable_t
      * coordinate space */
     void scissor(wlr_box box) const;
 
-    /* Will destroy the texture and framebuffer
-     * Warning: will destroy tex/fb even if they have been allocated outside of
+    /* Will return the texture and framebuffer to the framebuffer pool, which
+     * destroys them when it grows past its budget
+     * Warning: will release tex/fb even if they have been allocated outside of
      * allocate() */
     void release();
 
@@ -73,6 +96,92 @@ struct wf_framebuffer_base : public noncopyable_t
     void copy_state(wf_framebuffer_base&& other);
 };
 
+/* How the contents of a wf_gpu_buffer are updated */
+enum wf_gpu_buffer_usage
+{
+    /* The contents are uploaded once and rarely change, for ex. index
+     * buffers for a fixed mesh. Uploads reuse the existing storage. */
+    WF_BUFFER_PERSISTENT,
+    /* The whole contents are replaced by each upload. The old storage is
+     * orphaned, so that the driver doesn't have to wait for pending draws
+     * which still use it. */
+    WF_BUFFER_ORPHANED,
+    /* Many small uploads per frame, which are appended to the buffer without
+     * synchronization. The storage is orphaned only when it is full. */
+    WF_BUFFER_STREAMING,
+};
+
+/* A buffer on the GPU, used to store vertex and index data instead of
+ * passing client-side arrays to glVertexAttribPointer(), which forces the
+ * driver to copy the data on each draw.
+ *
+ * Vertex buffers (target GL_ARRAY_BUFFER) also have a vertex array object,
+ * which stores the attribute layout set with set_attribute(). Index buffers
+ * used together with a vertex buffer should be bound after the vertex
+ * buffer, so that the binding is stored in its vertex array.
+ *
+ * On GLES 2.0 contexts, buffers have no vertex array, and the attributes are
+ * set up again after each bind(). Instanced attributes (divisor > 0) are not
+ * supported there.
+ *
+ * Resources (buffer/vao) are not automatically destroyed */
+struct wf_gpu_buffer : public noncopyable_t
+{
+    GLuint buffer = -1, vao = -1;
+    GLenum target = GL_ARRAY_BUFFER;
+    wf_gpu_buffer_usage usage = WF_BUFFER_ORPHANED;
+
+    wf_gpu_buffer(GLenum target = GL_ARRAY_BUFFER,
+        wf_gpu_buffer_usage usage = WF_BUFFER_ORPHANED);
+    wf_gpu_buffer(wf_gpu_buffer&& other);
+    wf_gpu_buffer& operator = (wf_gpu_buffer&& other);
+
+    /* The functions below assume they are called between
+     * OpenGL::render_begin() and OpenGL::render_end() */
+
+    /* Upload size bytes of data to the buffer, creating it if necessary.
+     * The buffer is left bound to its target.
+     *
+     * Returns the offset in bytes at which the data was stored, to be used
+     * as offset in set_attribute() or for glDrawElements() */
+    size_t upload(const void *data, size_t size);
+
+    /* Streaming buffers orphan their storage when an upload doesn't fit, so
+     * data uploaded before that can't be used together with the new data.
+     * Make sure that the next uploads with a total of size bytes in the
+     * given number of uploads fit in the same storage. */
+    void reserve(size_t size, int uploads = 1);
+
+    /* Bind the buffer, and its vertex array if it is a vertex buffer. The
+     * buffer must have been uploaded at least once */
+    void bind() const;
+
+    /* Bind the default vertex array and unbind the buffer. Must be called
+     * before rendering with wlroots, which uses client-side arrays. On GLES
+     * 2.0 contexts, this also disables the attributes set up with
+     * set_attribute() */
+    void unbind() const;
+
+    /* Enable and set the layout of a vertex attribute stored in the buffer.
+     * The buffer must be bound. offset and stride are in bytes, and the
+     * components are GL_FLOATs */
+    void set_attribute(GLuint location, int components, size_t stride,
+        size_t offset, GLuint divisor = 0) const;
+
+    /* Will destroy the buffer and the vertex array */
+    void release();
+
+    private:
+    size_t capacity = 0, used = 0;
+    /* The attribute locations enabled without a vertex array, as a bitmask */
+    mutable uint32_t enabled_attributes = 0;
+    void copy_state(wf_gpu_buffer&& other);
+    /* Create the buffer if necessary, and bind it to its target */
+    void create_and_bind();
+    /* Orphan the storage of a streaming buffer if size bytes don't fit */
+    void ensure_space(size_t size);
+};
+
 /* A more feature-complete framebuffer.
  * It represents an area of the output, with the corresponding dimensions,
  * transforms, etc */
@@ -96,6 +205,9 @@ struct wf_framebuffer : public wf_framebuffer_base
     /* Get the box after applying the framebuffer scale */
     wlr_box damage_box_from_geometry_box(wlr_box box) const;
 
+    /* Same as damage_box_from_geometry_box(), for each box of the region */
+    wf_region damage_region_from_geometry_region(const wf_region& region) const;
+
     /* Get the projection of the given box onto the framebuffer.
      * The given box is in output-local coordinates, i.e the same coordinate
      * space as views */
@@ -122,19 +234,85 @@ namespace OpenGL
      * that's the only time we're guaranteed we have a valid GLES context
      *
      * The other functions below assume they are called between render_begin()
-     * and render_end() */
+     * and render_end()
+     *
+     * render_begin() can be nested in another render_begin(). The nested call
+     * only binds its framebuffer, and begins the wlroots renderer again only
+     * if the viewport size is different. */
     void render_begin(); // use if you just want to bind GL context but won't draw
     void render_begin(const wf_framebuffer_base& fb);
     void render_begin(int32_t viewport_width, int32_t viewport_height, uint32_t fb = 0);
 
     /* Call this to indicate an end of the rendering.
-     * Resets bound framebuffer and scissor box.
+     * Resets bound framebuffer, scissor box and the shadow GL state. A nested
+     * render_end() binds the framebuffer of the enclosing render_begin().
      * render_end() must be called for each render_begin() */
     void render_end();
 
+    /* A render pass begins rendering to a framebuffer when created, and ends
+     * it when destroyed. Code which renders many small pieces to the same
+     * framebuffer, each with its own render_begin() and render_end(), should
+     * open a render pass around them, so that the renderer is begun and
+     * ended only once. */
+    class render_pass_t : public noncopyable_t
+    {
+      public:
+        render_pass_t(const wf_framebuffer_base& fb);
+        ~render_pass_t();
+    };
+
     /* Clear the currently bound framebuffer with the given color */
     void clear(wf_color color, uint32_t mask = GL_COLOR_BUFFER_BIT);
 
+    /* Whether the context supports GLES 3.0. The version is checked once when
+     * core initializes OpenGL. GLES 2.0 contexts have no vertex arrays, buffer
+     * mapping, instanced attributes or program binaries, so code which uses
+     * them must check this and fall back to GLES 2.0 calls. */
+    bool context_supports_gles3();
+
+    /* The functions below do the same as the GL functions with the same name,
+     * but they keep a shadow copy of the GL state and skip the calls which
+     * wouldn't change it.
+     *
+     * The shadow state is reset in render_begin(), because wlroots changes
+     * the GL state behind our back. Code which changes the tracked state
+     * with direct GL calls or renders with wlroots, and then uses these
+     * functions before render_end(), must call invalidate_state() first. */
+    void use_program(GLuint program);
+    /* Bindings of 2D and cube map textures are tracked on the first few
+     * texture units, other bindings are always passed to GL */
+    void active_texture(GLenum unit);
+    void bind_texture(GLenum target, GLuint tex);
+    void bind_framebuffer(GLenum target, GLuint fb);
+    /* GL_BLEND, GL_SCISSOR_TEST, GL_DEPTH_TEST and GL_CULL_FACE are tracked,
+     * other capabilities are always passed to GL */
+    void enable(GLenum cap);
+    void disable(GLenum cap);
+    void blend_func(GLenum sfactor, GLenum dfactor);
+    void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    void scissor(GLint x, GLint y, GLsizei width, GLsizei height);
+
+    /* Delete the object, and forget its bindings in the shadow state, since
+     * GL unbinds deleted textures and framebuffers */
+    void delete_texture(GLuint tex);
+    void delete_framebuffer(GLuint fb);
+
+    /* Forget the shadow state, so that the next state changes are passed to GL */
+    void invalidate_state();
+
+    /* Counters of the state changes requested with the functions above */
+    struct state_statistics_t
+    {
+        /* Number of requested state changes */
+        uint32_t state_changes = 0;
+        /* Number of state changes which were skipped, because the shadow
+         * state showed they wouldn't change anything */
+        uint32_t redundant_state_changes = 0;
+    };
+
+    /* Return the counters accumulated since the last call and reset them */
+    state_statistics_t reset_state_statistics();
+
     /* texg arguments are used only when bits has USE_TEX_GEOMETRY
      * if you don't wish to use them, simply pass {} as argument */
     void render_transformed_texture(GLuint text,
@@ -144,16 +322,106 @@ namespace OpenGL
                                     glm::vec4 color = glm::vec4(1.f),
                                     uint32_t bits = 0);
 
+    /**
+     * A batch of textured quads which are rendered with the same texture,
+     * transform and color, but which may be clipped to different boxes.
+     *
+     * Rendering a texture once per damaged rectangle with
+     * render_transformed_texture() sets up the whole GL state for every
+     * rectangle. Instead, a batch sets up the state once when it is flushed,
+     * and uploads all quads to a vertex buffer at once.
+     *
+     * If the transform maps the quads to axis-aligned rectangles on the
+     * framebuffer, clipped quads are cut on the CPU and consecutive quads are
+     * rendered with a single draw call. Otherwise, each clip box is applied
+     * with a scissor, and quads with the same clip box share a draw call.
+     *
+     * The batch is meant to be used inside render_begin() / render_end(), and
+     * all of its clipped quads must be rendered to the same framebuffer.
+     */
+    class texture_batch_t
+    {
+      public:
+        /* The arguments have the same meaning as in render_transformed_texture */
+        texture_batch_t(GLuint tex, glm::mat4 transform = glm::mat4(1.0),
+            glm::vec4 color = glm::vec4(1.f), uint32_t bits = 0);
+
+        /* Add a quad, which uses the current scissor box when rendered.
+         * texg is used only if bits has TEXTURE_USE_TEX_GEOMETRY */
+        void add_quad(const gl_geometry& g, const gl_geometry& texg = {});
+
+        /* Add a quad, clipped to the given box on fb. The box has the same
+         * coordinate system as in wf_framebuffer_base::scissor() */
+        void add_quad(const gl_geometry& g, const gl_geometry& texg,
+            const wf_framebuffer_base& fb, wlr_box clip);
+
+        /* Add a quad for each rectangle of the damage region, clipped to it */
+        void add_quad(const gl_geometry& g, const gl_geometry& texg,
+            const wf_framebuffer& fb, const wf_region& damage);
+
+        /* Render all added quads to the currently bound framebuffer and
+         * clear the batch */
+        void flush();
+
+        /* @return The number of quads waiting to be rendered */
+        size_t size() const;
+
+      private:
+        struct vertex_t
+        {
+            GLfloat x, y, u, v;
+        };
+
+        enum clip_mode_t
+        {
+            /* Rendered with the current scissor box */
+            CLIP_NONE,
+            /* Rendered with a scissor box */
+            CLIP_SCISSOR,
+            /* Cut on the CPU, the scissor box is needed only for safety */
+            CLIP_GEOMETRY,
+        };
+
+        struct quad_t
+        {
+            clip_mode_t mode;
+            wlr_box clip;
+        };
+
+        GLuint tex;
+        glm::mat4 transform;
+        glm::vec4 color;
+        uint32_t bits;
+
+        std::vector<vertex_t> vertices;
+        std::vector<quad_t> quads;
+        const wf_framebuffer_base *target = nullptr;
+
+        void push_quad(const gl_geometry& g, const gl_geometry& texg,
+            float s1, float s2, float t1, float t2);
+        bool clip_on_cpu(const gl_geometry& g, const wf_framebuffer_base& fb,
+            wlr_box clip, float& s1, float& s2, float& t1, float& t2);
+    };
+
     /* Reads the shader source from the given file and compiles it */
     GLuint load_shader(std::string path, GLuint type);
     /* Compiles the given shader source */
     GLuint compile_shader(std::string source, GLuint type);
 
-    /* Create a very simple gl program from the given shader sources */
+    /* Create a very simple gl program from the given shader sources.
+     *
+     * Programs with the same sources are shared, for ex. between the
+     * instances of a plugin on different outputs, and linked programs are
+     * cached on disk. Because of this, the program must be destroyed with
+     * destroy_program() instead of glDeleteProgram(), and the caller must
+     * not change its attached shaders. */
     GLuint create_program_from_source(std::string vertex_source,
         std::string frag_source);
     /* Same as create_program_from_source, but loads shaders from files */
     GLuint create_program(std::string vertex_path, std::string frag_path);
+    /* Release a program created with the functions above. It is deleted when
+     * all users of a shared program have released it */
+    void destroy_program(GLuint program);
 }
 
 /* utils */
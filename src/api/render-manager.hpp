@@ -4,6 +4,9 @@
 #include "output.hpp"
 #include "object.hpp"
 
+#include <ctime>
+#include <vector>
+
 struct wf_framebuffer_base;
 struct wf_framebuffer;
 struct wf_region;
@@ -52,6 +55,67 @@ enum output_effect_type_t
 using post_hook_t = std::function<void(const wf_framebuffer_base& source,
     const wf_framebuffer_base& destination)>;
 
+/** The phases of an output repaint, as recorded in frame_statistics_t */
+enum frame_phase_t
+{
+    /* Running the OUTPUT_EFFECT_PRE hooks */
+    FRAME_PHASE_PRE_EFFECTS = 0,
+    /* Running the render hook or the default renderer */
+    FRAME_PHASE_RENDER_OUTPUT = 1,
+    /* Running the OUTPUT_EFFECT_OVERLAY hooks */
+    FRAME_PHASE_OVERLAY_EFFECTS = 2,
+    /* Rendering software cursors */
+    FRAME_PHASE_SOFTWARE_CURSORS = 3,
+    /* Running the postprocessing hooks */
+    FRAME_PHASE_POST_EFFECTS = 4,
+    /* Committing the output buffer */
+    FRAME_PHASE_SWAP_BUFFERS = 5,
+
+    /* Number of phases, used internally */
+    FRAME_PHASE_TOTAL = 6,
+};
+
+/** Timing and damage information about a single repainted frame */
+struct frame_statistics_t
+{
+    /** The time the repaint started, in CLOCK_MONOTONIC */
+    timespec repaint_started = {0, 0};
+    /** Time spent in each of the phases, in microseconds */
+    int64_t phase_usec[FRAME_PHASE_TOTAL] = {0};
+    /** Time from the start of the repaint until the buffers were swapped */
+    int64_t total_usec = 0;
+
+    /** The area of the swapped damage, in output pixels */
+    uint64_t damaged_pixels = 0;
+    /** Number of surfaces and views which were scheduled for rendering */
+    uint32_t surfaces_scheduled = 0;
+    /** Number of surfaces and views which were visible on a repainted
+     * workspace, but were skipped because none of their area was damaged */
+    uint32_t surfaces_culled = 0;
+
+    /** Number of GL state changes requested through the OpenGL state cache */
+    uint32_t gl_state_changes = 0;
+    /** Number of those state changes which were skipped as redundant */
+    uint32_t gl_redundant_state_changes = 0;
+
+    /** Number of heap allocations with operator new while scheduling the
+     * surfaces of the repainted workspace streams. Only counted in debug
+     * builds, and 0 otherwise. */
+    uint32_t repaint_allocations = 0;
+};
+
+/** Emitted by the render manager with the name "frame-stats" after each
+ * repainted frame */
+struct frame_stats_signal : public wf::signal_data_t
+{
+    const frame_statistics_t *stats;
+};
+
+namespace signals
+{
+const signal_descriptor_t<frame_stats_signal> frame_stats{"frame-stats"};
+}
+
 /** Render manager
  *
  * Each output has a render manager, which is responsible for all rendering
@@ -188,9 +252,14 @@ class render_manager : public wf::signal_provider_t
      * This function should be called inside the rendering cycle, i.e in a
      * render or an overlay hook.
      *
+     * The stream can be rendered at a reduced resolution, if the plugin
+     * displays it scaled down. The stream is rendered with the larger of
+     * the two scales, rounded up to a multiple of 1/8, and its buffer is
+     * resized accordingly.
+     *
      * @param stream The workspace stream to update
-     * @param scale_x Unused for now
-     * @param scale_y Unused for now
+     * @param scale_x The horizontal scale of the stream, at most 1
+     * @param scale_y The vertical scale of the stream, at most 1
      */
     void workspace_stream_update(workspace_stream_t& stream,
         float scale_x = 1, float scale_y = 1);
@@ -201,6 +270,13 @@ class render_manager : public wf::signal_provider_t
      * @param stream The stream to be stopped
      */
     void workspace_stream_stop(workspace_stream_t& stream);
+
+    /**
+     * @return The statistics of the last repainted frames of the output,
+     * ordered from the oldest to the newest frame. Only frames which were
+     * actually repainted are recorded.
+     */
+    std::vector<frame_statistics_t> get_frame_statistics() const;
   private:
     class impl;
     std::unique_ptr<impl> pimpl;
@@ -39,6 +39,18 @@ struct view_geometry_changed_signal : public _view_signal
     wf_geometry old_geometry;
 };
 
+namespace wf
+{
+namespace signals
+{
+/* Emitted on the view each time its geometry changes */
+const signal_descriptor_t<view_geometry_changed_signal>
+    geometry_changed{"geometry-changed"};
+/* Emitted on the view each time it is damaged, without data */
+const signal_descriptor_t<signal_data_t> damaged_region{"damaged-region"};
+}
+}
+
 struct view_tiled_signal : public _view_signal
 {
     uint32_t edges;
@@ -82,6 +82,32 @@ class surface_interface_t
     virtual std::vector<surface_iterator_t> enumerate_surfaces(
         wf_point surface_origin = {0, 0});
 
+    /**
+     * Call func for each mapped surface in the surface tree, including the
+     * surface itself, in the same order as enumerate_surfaces().
+     *
+     * The surface tree is flattened once and updated only when a surface in
+     * it is mapped, unmapped, added, removed or restacked, so unlike
+     * enumerate_surfaces(), this doesn't allocate.
+     *
+     * @param func The function to call with each surface and its position,
+     *        as a const surface_iterator_t&. It is a template parameter, since
+     *        std::function allocates for lambdas with several captures.
+     * @param surface_origin The coordinates of the top-left corner of the
+     *        surface.
+     * @param bottom_up Whether to start from the bottom-most surface, for
+     *        ex. when rendering.
+     */
+    template<class Func>
+    void for_each_surface(Func func, wf_point surface_origin = {0, 0},
+        bool bottom_up = false)
+    {
+        visit_surfaces([] (void *data, const surface_iterator_t& child)
+        {
+            (*static_cast<Func*> (data))(child);
+        }, &func, surface_origin, bottom_up);
+    }
+
     /**
      * @return The output the surface is currently attached to. Note this
      * doesn't necessarily mean that it is visible.
@@ -184,6 +210,12 @@ class surface_interface_t
      * accessed after calling destruct().
      */
     virtual void destruct();
+
+  private:
+    using surface_visitor_t = void (*)(void*, const surface_iterator_t&);
+    /** Implements for_each_surface(), calls visitor with data and each surface */
+    void visit_surfaces(surface_visitor_t visitor, void *data,
+        wf_point surface_origin, bool bottom_up);
 };
 void emit_map_state_change(wf::surface_interface_t *surface);
 }
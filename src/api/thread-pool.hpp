@@ -0,0 +1,84 @@
+#ifndef WF_THREAD_POOL_HPP
+#define WF_THREAD_POOL_HPP
+
+#include <functional>
+#include <memory>
+#include <nonstd/noncopyable.hpp>
+
+extern "C"
+{
+    struct wl_event_loop;
+}
+
+namespace wf
+{
+/**
+ * A pool of worker threads, owned by core and available to plugins via
+ * wf::get_core().thread_pool. It can be used to split CPU heavy work, like
+ * updating particles or meshes, over all CPUs, or to run work in the
+ * background without blocking the compositor.
+ *
+ * Each worker has its own queue of tasks, and idle workers steal tasks from
+ * the queues of busy workers.
+ *
+ * The tasks must not use GL, wlroots or any other compositor state, except
+ * for data which the plugin owns and doesn't access in the meantime. If a
+ * task may still be running when the plugin is unloaded, it should keep its
+ * data alive itself, for ex. by capturing a std::shared_ptr.
+ */
+class thread_pool_t : public noncopyable_t
+{
+  public:
+    using task_t = std::function<void()>;
+    using range_task_t = std::function<void(int start, int end)>;
+
+    /** Used as affinity for tasks which can run on any worker */
+    static constexpr int ANY_WORKER = -1;
+
+    /**
+     * Create a thread pool. Plugins do not need to create thread pools, since
+     * core creates one at startup.
+     *
+     * @param loop The event loop in which completion callbacks are run. The
+     *        pool may outlive it, but completion callbacks are dropped after
+     *        the loop is destroyed.
+     * @param workers The number of worker threads, 0 for one less than the
+     *        number of CPUs, since the main thread also runs parallel_for()
+     */
+    thread_pool_t(wl_event_loop *loop, int workers = 0);
+
+    /** Stop the workers. Tasks which haven't been started are dropped. */
+    ~thread_pool_t();
+
+    /** @return The number of worker threads */
+    int get_worker_count() const;
+
+    /**
+     * Run a task on a worker thread.
+     *
+     * @param task The task to run
+     * @param on_complete Called on the main thread, from the event loop, after
+     *        the task has finished. Can be empty.
+     * @param affinity The index of the worker which should run the task, modulo
+     *        the number of workers, or ANY_WORKER. Tasks with the same affinity
+     *        usually run on the same thread, which keeps their data in its
+     *        caches, but idle workers can still steal them.
+     */
+    void submit(task_t task, task_t on_complete = nullptr,
+        int affinity = ANY_WORKER);
+
+    /**
+     * Split [begin, end) in ranges of at most grain elements, call task for
+     * each range in parallel, and wait until all of them are done. The calling
+     * thread runs ranges too, so parallel_for() works even if all workers are
+     * busy, and can be used from a task.
+     */
+    void parallel_for(int begin, int end, int grain, const range_task_t& task);
+
+  private:
+    class impl;
+    std::unique_ptr<impl> pimpl;
+};
+}
+
+#endif /* end of include guard: WF_THREAD_POOL_HPP */
@@ -9,6 +9,20 @@
 #include "geometry.hpp"
 
 /* ---------------------- pixman utility functions -------------------------- */
+
+/**
+ * A region backed by a pixman_region32_t.
+ *
+ * pixman allocates the rectangles of a region as soon as it has more than one
+ * rectangle. Since most regions are temporaries which live only for a part of
+ * a frame, the rectangle storage of destroyed regions is kept in a small
+ * per-thread pool, and the results of operations reuse it, so that region
+ * arithmetic usually doesn't allocate. The operators on temporaries (for ex.
+ * (a & box) + delta) work in place instead of creating another region.
+ *
+ * The storage is still owned by pixman, so to_pixman() can be passed to any
+ * pixman or wlroots function.
+ */
 struct wf_region
 {
     wf_region();
@@ -31,27 +45,35 @@ struct wf_region
     bool contains_point(const wf_point& point) const;
 
     /* Translate the region */
-    wf_region operator + (const wf_point& vector) const;
+    wf_region operator + (const wf_point& vector) const &;
+    wf_region operator + (const wf_point& vector) &&;
     wf_region& operator += (const wf_point& vector);
 
-    wf_region operator * (float scale) const;
+    wf_region operator * (float scale) const &;
+    wf_region operator * (float scale) &&;
     wf_region& operator *= (float scale);
 
     /* Region intersection */
-    wf_region operator & (const wlr_box& box) const;
-    wf_region operator & (const wf_region& other) const;
+    wf_region operator & (const wlr_box& box) const &;
+    wf_region operator & (const wlr_box& box) &&;
+    wf_region operator & (const wf_region& other) const &;
+    wf_region operator & (const wf_region& other) &&;
     wf_region& operator &= (const wlr_box& box);
     wf_region& operator &= (const wf_region& other);
 
     /* Region union */
-    wf_region operator | (const wlr_box& other) const;
-    wf_region operator | (const wf_region& other) const;
+    wf_region operator | (const wlr_box& other) const &;
+    wf_region operator | (const wlr_box& other) &&;
+    wf_region operator | (const wf_region& other) const &;
+    wf_region operator | (const wf_region& other) &&;
     wf_region& operator |= (const wlr_box& other);
     wf_region& operator |= (const wf_region& other);
 
     /* Subtract the box/region from the current region */
-    wf_region operator ^ (const wlr_box& box) const;
-    wf_region operator ^ (const wf_region& other) const;
+    wf_region operator ^ (const wlr_box& box) const &;
+    wf_region operator ^ (const wlr_box& box) &&;
+    wf_region operator ^ (const wf_region& other) const &;
+    wf_region operator ^ (const wf_region& other) &&;
     wf_region& operator ^= (const wlr_box& box);
     wf_region& operator ^= (const wf_region& other);
 
@@ -62,6 +84,12 @@ struct wf_region
 
     private:
     pixman_region32_t _region;
+
+    /* Creates an empty region which reuses pooled rectangle storage, if
+     * recycle is set and the pool has any */
+    struct recycled_t {};
+    wf_region(recycled_t, bool recycle);
+
     /* Returns a const-casted pixman_region32_t*, useful in const operators
      * where we use this->_region as only source for calculations, but pixman
      * won't let us pass a const pixman_region32_t* */
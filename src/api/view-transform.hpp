@@ -47,8 +47,8 @@ class wf_view_transformer_t
          *
          * The default implementation of render_with_damage() will simply iterate
          * over all rectangles in the damage region, apply framebuffer transform
-         * to it and then call render_box(). Plugins can override either of the
-         * functions.
+         * to it and then call render_box(), inside a render pass on target_fb.
+         * Plugins can override either of the functions.
          * */
 
         virtual void render_with_damage(uint32_t src_tex, wlr_box src_box,
@@ -57,7 +57,23 @@ class wf_view_transformer_t
         virtual void render_box(uint32_t src_tex, wlr_box src_box,
             wlr_box scissor_box, const wf_framebuffer& target_fb) {}
 
+        /* Map damage of the transform's source to the region of its result
+         * which has to be repainted. Both damage and the result are in the
+         * same coordinate system as view.
+         *
+         * It is called once per frame for transforms which render to an
+         * intermediate buffer, so that only the damaged parts of the buffer
+         * are repainted. Since the transform may have changed since the last
+         * frame, the default implementation returns the whole bounding box. */
+        virtual wf_region transform_damage(wf_geometry view,
+            const wf_region& damage);
+
         virtual ~wf_view_transformer_t() {}
+
+    protected:
+        /* Map each rectangle of damage separately with get_bounding_box() */
+        wf_region transform_damage_boxes(wf_geometry view,
+            const wf_region& damage);
 };
 
 /* 2D transforms operate with a coordinate system centered at the
@@ -82,6 +98,24 @@ class wf_2D_view : public wf_view_transformer_t
 
         virtual void render_box(uint32_t src_tex, wlr_box src_box,
             wlr_box scissor_box, const wf_framebuffer& target_fb);
+
+        /* Renders all damaged rectangles in a single batch */
+        virtual void render_with_damage(uint32_t src_tex, wlr_box src_box,
+            const wf_region& damage, const wf_framebuffer& target_fb);
+
+        virtual wf_region transform_damage(wf_geometry view,
+            const wf_region& damage);
+
+    protected:
+        /* Calculate the geometry of the quad and the transform to use when
+         * rendering src_box to fb */
+        glm::mat4 calculate_render_transform(wlr_box src_box,
+            const wf_framebuffer& fb, gl_geometry& geometry);
+
+    private:
+        /* The parameters from the last transform_damage() call */
+        glm::mat4 last_transform{0.0};
+        float last_alpha = 0.0;
 };
 
 /* Those are centered relative to the view's bounding box */
@@ -107,9 +141,27 @@ class wf_3D_view : public wf_view_transformer_t
         virtual void render_box(uint32_t src_tex, wlr_box src_box,
             wlr_box scissor_box, const wf_framebuffer& target_fb);
 
+        /* Renders all damaged rectangles in a single batch */
+        virtual void render_with_damage(uint32_t src_tex, wlr_box src_box,
+            const wf_region& damage, const wf_framebuffer& target_fb);
+
+        virtual wf_region transform_damage(wf_geometry view,
+            const wf_region& damage);
+
         static const float fov; // PI / 8
         static glm::mat4 default_view_matrix();
         static glm::mat4 default_proj_matrix();
+
+    protected:
+        /* Calculate the geometry of the quad and the transform to use when
+         * rendering src_box to fb */
+        glm::mat4 calculate_render_transform(wlr_box src_box,
+            const wf_framebuffer& fb, gl_geometry& geometry);
+
+    private:
+        /* The parameters from the last transform_damage() call */
+        glm::mat4 last_transform{0.0};
+        glm::vec4 last_color{0.0};
 };
 
 /* create a matrix which corresponds to the inverse of the given transform */
@@ -390,6 +390,18 @@ class view_interface_t : public surface_interface_t, public wf::object_base_t
      */
     virtual void damage_box(const wlr_box& box);
 
+    /**
+     * Same as damage_raw(), but for a whole region. The damage is applied to
+     * the output at once, and damaged-region is emitted only once.
+     */
+    virtual void damage_raw_region(const wf_region& region);
+
+    /**
+     * Same as damage_box(), but for a whole region. The damage is applied to
+     * the output at once, and damaged-region is emitted only once.
+     */
+    virtual void damage_region(const wf_region& region);
+
     /**
      * @return the bounding box of the view before transformers
      */
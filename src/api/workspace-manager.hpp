@@ -97,6 +97,17 @@ class workspace_manager
     std::vector<wayfire_view> get_views_on_workspace(wf_point ws,
         uint32_t layer_mask, bool wm_only);
 
+    /**
+     * Call func for each view visible on the given workspace, in the same
+     * order as get_views_on_workspace(), but without copying the views.
+     *
+     * The views are looked up in an index, so this is cheap even with many
+     * views on other workspaces. func must not add, remove or restack views,
+     * and it must not query the workspace manager for views.
+     */
+    void for_each_view_on_workspace(wf_point ws, uint32_t layer_mask,
+        bool wm_only, const std::function<void(wayfire_view)>& func);
+
     /**
      * Ensure that the view's wm_geometry is visible on the workspace ws. This
      * involves moving the view as appropriate.
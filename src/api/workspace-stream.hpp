@@ -38,6 +38,16 @@ struct stream_signal_t : public wf::signal_data_t
     wf_region& raw_damage;
     const wf_framebuffer& fb;
 };
+
+namespace signals
+{
+/* Emitted by the render manager before and after a workspace stream is
+ * repainted */
+const signal_descriptor_t<stream_signal_t>
+    workspace_stream_pre{"workspace-stream-pre"};
+const signal_descriptor_t<stream_signal_t>
+    workspace_stream_post{"workspace-stream-post"};
+}
 }
 
 #endif /* end of include guard: WF_WORKSPACE_STREAM_HPP */
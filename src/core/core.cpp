@@ -32,6 +32,7 @@ extern "C"
 #include "debug.hpp"
 #include "opengl-priv.hpp"
 #include "output.hpp"
+#include "thread-pool.hpp"
 #include "workspace-manager.hpp"
 #include "seat/input-manager.hpp"
 #include "seat/touch.hpp"
@@ -175,6 +176,9 @@ void wf::compositor_core_impl_t::init()
     wf_shell = wayfire_shell_create(display);
     gtk_shell = wf_gtk_shell_create(display);
 
+    thread_pool = std::make_unique<wf::thread_pool_t> (ev_loop,
+        config->get_section("core")->get_option("worker_threads", "0")->as_int());
+
     image_io::init();
     OpenGL::init();
 }
@@ -504,8 +508,10 @@ wf::compositor_core_t::~compositor_core_t() {};
 wf::compositor_core_impl_t::compositor_core_impl_t() {}
 wf::compositor_core_impl_t::~compositor_core_impl_t()
 {
-    /* Unloading order is important. First we want to free any remaining views,
+    /* Unloading order is important. First we stop the worker threads, which
+     * may run tasks of plugins, then we free any remaining views,
      * then we destroy the input manager, and finally the rest is auto-freed */
+    thread_pool.reset();
     views.clear();
     input.release();
 }
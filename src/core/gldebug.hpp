@@ -1,45 +1,50 @@
-#include <GLES3/gl32.h>
+#include <GLES3/gl3.h>
+#include <GLES2/gl2ext.h>
+#include <EGL/egl.h>
+#include <cstring>
 #include <debug.hpp>
 
-const char *getStrSrc(GLenum src)
+static const char *getStrSrc(GLenum src)
 {
-    if(src == GL_DEBUG_SOURCE_API            )return "API";
-    if(src == GL_DEBUG_SOURCE_WINDOW_SYSTEM  )return "WINDOW_SYSTEM";
-    if(src == GL_DEBUG_SOURCE_SHADER_COMPILER)return "SHADER_COMPILER";
-    if(src == GL_DEBUG_SOURCE_THIRD_PARTY    )return "THIRD_PARTYB";
-    if(src == GL_DEBUG_SOURCE_APPLICATION    )return "APPLICATIONB";
-    if(src == GL_DEBUG_SOURCE_OTHER          )return "OTHER";
+    if(src == GL_DEBUG_SOURCE_API_KHR            )return "API";
+    if(src == GL_DEBUG_SOURCE_WINDOW_SYSTEM_KHR  )return "WINDOW_SYSTEM";
+    if(src == GL_DEBUG_SOURCE_SHADER_COMPILER_KHR)return "SHADER_COMPILER";
+    if(src == GL_DEBUG_SOURCE_THIRD_PARTY_KHR    )return "THIRD_PARTYB";
+    if(src == GL_DEBUG_SOURCE_APPLICATION_KHR    )return "APPLICATIONB";
+    if(src == GL_DEBUG_SOURCE_OTHER_KHR          )return "OTHER";
     else return "UNKNOWN";
 }
 
-const char *getStrType(GLenum type)
+static const char *getStrType(GLenum type)
 {
-    if(type == GL_DEBUG_TYPE_ERROR              )return "ERROR";
-    if(type == GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR)return "DEPRECATED_BEHAVIOR";
-    if(type == GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR )return "UNDEFINED_BEHAVIOR";
-    if(type == GL_DEBUG_TYPE_PORTABILITY        )return "PORTABILITY";
-    if(type == GL_DEBUG_TYPE_PERFORMANCE        )return "PERFORMANCE";
-    if(type == GL_DEBUG_TYPE_OTHER              )return "OTHER";
+    if(type == GL_DEBUG_TYPE_ERROR_KHR              )return "ERROR";
+    if(type == GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR_KHR)return "DEPRECATED_BEHAVIOR";
+    if(type == GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR_KHR )return "UNDEFINED_BEHAVIOR";
+    if(type == GL_DEBUG_TYPE_PORTABILITY_KHR        )return "PORTABILITY";
+    if(type == GL_DEBUG_TYPE_PERFORMANCE_KHR        )return "PERFORMANCE";
+    if(type == GL_DEBUG_TYPE_OTHER_KHR              )return "OTHER";
     return "UNKNOWN";
 }
 
-const char *getStrSeverity(GLenum severity)
+static const char *getStrSeverity(GLenum severity)
 {
-    if(severity == GL_DEBUG_SEVERITY_HIGH  )return "HIGH";
-    if(severity == GL_DEBUG_SEVERITY_MEDIUM)return "MEDIUM";
-    if(severity == GL_DEBUG_SEVERITY_LOW   )return "LOW";
-    if(severity == GL_DEBUG_SEVERITY_NOTIFICATION) return "NOTIFICATION";
+    if(severity == GL_DEBUG_SEVERITY_HIGH_KHR  )return "HIGH";
+    if(severity == GL_DEBUG_SEVERITY_MEDIUM_KHR)return "MEDIUM";
+    if(severity == GL_DEBUG_SEVERITY_LOW_KHR   )return "LOW";
+    if(severity == GL_DEBUG_SEVERITY_NOTIFICATION_KHR) return "NOTIFICATION";
     return "UNKNOWN";
 }
 
-void errorHandler(GLenum src, GLenum type, GLuint id, GLenum severity,
-    GLsizei len, const GLchar *msg, const void *dummy)
+/* Note: in asynchronous mode, the driver may call this from another thread */
+static void GL_APIENTRY errorHandler(GLenum src, GLenum type, GLuint id,
+    GLenum severity, GLsizei len, const GLchar *msg, const void *dummy)
 {
     // ignore notifications
-    if(severity == GL_DEBUG_SEVERITY_NOTIFICATION)
+    if(severity == GL_DEBUG_SEVERITY_NOTIFICATION_KHR)
         return;
 
-    log_info(
+    auto verbosity = (type == GL_DEBUG_TYPE_ERROR_KHR ? WLR_ERROR : WLR_INFO);
+    wf_log(verbosity,
         "_______________________________________________\n"
         "Source: %s\n"
         "Type: %s\n"
@@ -49,9 +54,32 @@ void errorHandler(GLenum src, GLenum type, GLuint id, GLenum severity,
         getStrSrc(src), getStrType(type), getStrSeverity(severity), msg);
 }
 
-void enable_gl_synchronuous_debug()
+/**
+ * Report GL errors and other debug messages with KHR_debug.
+ *
+ * @param synchronous Whether messages should be reported from the GL call
+ *        which caused them. This is useful with a debugger, but it
+ *        serializes the driver.
+ *
+ * @return false if the context doesn't support KHR_debug
+ */
+static bool enable_gl_debug_output(bool synchronous)
 {
-    glEnable(GL_DEBUG_OUTPUT);
-    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
-    glDebugMessageCallback(errorHandler, 0);
+    auto extensions = (const char*)glGetString(GL_EXTENSIONS);
+    if (!extensions || !std::strstr(extensions, "GL_KHR_debug"))
+        return false;
+
+    auto debug_message_callback = (PFNGLDEBUGMESSAGECALLBACKKHRPROC)
+        eglGetProcAddress("glDebugMessageCallbackKHR");
+    if (!debug_message_callback)
+        return false;
+
+    glEnable(GL_DEBUG_OUTPUT_KHR);
+    if (synchronous)
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS_KHR);
+    else
+        glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS_KHR);
+
+    debug_message_callback(errorHandler, 0);
+    return true;
 }
@@ -1,12 +1,35 @@
 #include "object.hpp"
 #include "nonstd/safe-list.hpp"
+#include "debug.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
 #include <unordered_map>
+#include <vector>
+
+wf::signal_id_t wf::intern_signal(const std::string& name)
+{
+    static std::unordered_map<std::string, signal_id_t> interned;
+
+    auto it = interned.find(name);
+    if (it != interned.end())
+        return it->second;
+
+    signal_id_t id = interned.size();
+    interned[name] = id;
+    return id;
+}
 
 class wf::signal_provider_t::sprovider_impl
 {
   public:
-    std::unordered_map<std::string,
+    /* Signals get an entry when they are first connected, so emitting a
+     * signal nobody listens to is a single lookup */
+    std::unordered_map<signal_id_t,
         wf::safe_list_t<signal_callback_t*>> signals;
+
+    /* Connections which are connected to this provider */
+    std::vector<signal_connection_base_t*> connections;
 };
 
 wf::signal_provider_t::signal_provider_t()
@@ -16,34 +39,135 @@ wf::signal_provider_t::signal_provider_t()
 
 wf::signal_provider_t::~signal_provider_t()
 {
+    for (auto connection : sprovider_priv->connections)
+        connection->provider = nullptr;
 }
 
-void wf::signal_provider_t::connect_signal(std::string name,
+void wf::signal_provider_t::connect_signal(signal_id_t id,
     signal_callback_t* callback)
 {
-    sprovider_priv->signals[name].push_back(callback);
+    sprovider_priv->signals[id].push_back(callback);
 }
 
 /* Unregister a registered callback */
-void wf::signal_provider_t::disconnect_signal(std::string name,
+void wf::signal_provider_t::disconnect_signal(signal_id_t id,
     signal_callback_t* callback)
 {
-    sprovider_priv->signals[name].remove_all(callback);
+    auto it = sprovider_priv->signals.find(id);
+    if (it != sprovider_priv->signals.end())
+        it->second.remove_all(callback);
 }
 
 /* Emit the given signal. No type checking for data is required */
-void wf::signal_provider_t::emit_signal(std::string name, wf::signal_data_t *data)
+void wf::signal_provider_t::emit_signal(signal_id_t id, wf::signal_data_t *data)
 {
-    sprovider_priv->signals[name].for_each([data] (auto call) {
+    auto it = sprovider_priv->signals.find(id);
+    if (it == sprovider_priv->signals.end())
+        return;
+
+    it->second.for_each([data] (auto call) {
         (*call) (data);
     });
 }
 
+void wf::signal_provider_t::connect_signal(const std::string& name,
+    signal_callback_t* callback)
+{
+    connect_signal(intern_signal(name), callback);
+}
+
+void wf::signal_provider_t::disconnect_signal(const std::string& name,
+    signal_callback_t* callback)
+{
+    disconnect_signal(intern_signal(name), callback);
+}
+
+void wf::signal_provider_t::emit_signal(const std::string& name,
+    wf::signal_data_t *data)
+{
+    emit_signal(intern_signal(name), data);
+}
+
+void wf::signal_provider_t::connect_connection(signal_id_t id,
+    signal_connection_base_t *connection)
+{
+    connection->disconnect();
+    connection->provider = this;
+    connection->id = id;
+
+    sprovider_priv->connections.push_back(connection);
+    connect_signal(id, &connection->dispatch);
+}
+
+void wf::signal_provider_t::disconnect_connection(
+    signal_connection_base_t *connection)
+{
+    disconnect_signal(connection->id, &connection->dispatch);
+
+    auto& connections = sprovider_priv->connections;
+    auto it = std::remove(connections.begin(), connections.end(), connection);
+    connections.erase(it, connections.end());
+}
+
+void wf::signal_connection_base_t::disconnect()
+{
+    if (provider)
+        provider->disconnect_connection(this);
+
+    provider = nullptr;
+}
+
+wf::signal_connection_base_t::~signal_connection_base_t()
+{
+    disconnect();
+}
+
+namespace
+{
+/* The name of the type registered for each custom data slot */
+std::vector<std::string>& get_slot_types()
+{
+    static std::vector<std::string> slot_types;
+    return slot_types;
+}
+}
+
+uint32_t wf::register_custom_data_slot(const std::string& type_name)
+{
+    static std::unordered_map<std::string, uint32_t> slots;
+    auto& slot_types = get_slot_types();
+
+    /* Types in anonymous namespaces have the same name in all translation
+     * units, but are different types, so they never share a slot. Each one
+     * is registered only once, by custom_data_slot<T>(). */
+    bool anonymous = type_name.find("_GLOBAL__N_") != std::string::npos;
+    if (!anonymous)
+    {
+        auto it = slots.find(type_name);
+        if (it != slots.end())
+            return it->second;
+    }
+
+    uint32_t slot = slot_types.size();
+    slot_types.push_back(type_name);
+    if (!anonymous)
+        slots[type_name] = slot;
+
+    return slot;
+}
+
 class wf::object_base_t::obase_impl
 {
   public:
     std::unordered_map<std::string, std::unique_ptr<custom_data_t>> data;
     uint32_t object_id;
+
+    /* The first slots are stored inline, which is enough for the types core
+     * and the usual plugins use. Slots with higher indices are allocated
+     * when they are first stored. */
+    static constexpr uint32_t inline_slots = 8;
+    std::array<std::unique_ptr<custom_data_t>, inline_slots> slots;
+    std::vector<std::unique_ptr<custom_data_t>> extra_slots;
 };
 
 wf::object_base_t::object_base_t()
@@ -96,3 +220,46 @@ void wf::object_base_t::_store_data(std::unique_ptr<wf::custom_data_t> data,
 {
     obase_priv->data[name] = std::move(data);
 }
+
+wf::custom_data_t *wf::object_base_t::_fetch_slot(uint32_t slot,
+    const char *type_name)
+{
+#ifdef WAYFIRE_DEBUG_ENABLED
+    auto& slot_types = get_slot_types();
+    if (slot >= slot_types.size() || slot_types[slot] != type_name)
+    {
+        log_error("custom data slot %u is used with type %s", slot, type_name);
+        assert(false);
+    }
+#endif
+
+    if (slot < obase_impl::inline_slots)
+        return obase_priv->slots[slot].get();
+
+    slot -= obase_impl::inline_slots;
+    if (slot < obase_priv->extra_slots.size())
+        return obase_priv->extra_slots[slot].get();
+
+    return nullptr;
+}
+
+void wf::object_base_t::_store_slot(uint32_t slot,
+    std::unique_ptr<custom_data_t> data)
+{
+    if (slot < obase_impl::inline_slots)
+    {
+        obase_priv->slots[slot] = std::move(data);
+        return;
+    }
+
+    slot -= obase_impl::inline_slots;
+    if (slot >= obase_priv->extra_slots.size())
+    {
+        if (!data)
+            return;
+
+        obase_priv->extra_slots.resize(slot + 1);
+    }
+
+    obase_priv->extra_slots[slot] = std::move(data);
+}
@@ -1,8 +1,21 @@
 #include <fstream>
+#include <cstddef>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <list>
+#include <map>
+#include <cerrno>
+#include <cstdio>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "opengl-priv.hpp"
 #include "debug.hpp"
 #include "output.hpp"
 #include "core-impl.hpp"
+#include "gldebug.hpp"
 
 extern "C"
 {
@@ -29,16 +42,403 @@ const char* gl_error_string(const GLenum err) {
     return "UNKNOWN GL ERROR";
 }
 
+/* Set when core/gl_error_checks is sync. glGetError() waits for the GPU on
+ * many drivers, so it is not called otherwise. */
+static bool gl_sync_error_checks = false;
+
 void gl_call(const char *func, uint32_t line, const char *glfunc) {
+    if (!gl_sync_error_checks)
+        return;
+
     GLenum err;
     if ((err = glGetError()) == GL_NO_ERROR)
         return;
 
-    log_error("gles2: function %s in %s line %u: %s", glfunc, func, line, gl_error_string(glGetError()));
+    log_error("gles2: function %s in %s line %u: %s", glfunc, func, line, gl_error_string(err));
 }
 
+/* Enable the error checking mode selected with core/gl_error_checks,
+ * limited to what the build supports */
+static void setup_gl_error_checks()
+{
+    auto mode = wf::get_core().config->get_section("core")->get_option(
+        "gl_error_checks", WAYFIRE_GL_ERROR_CHECKS_DEFAULT)->as_string();
+
+    int level = WF_GL_ERROR_CHECKS_OFF;
+    if (mode == "callback")
+        level = WF_GL_ERROR_CHECKS_CALLBACK;
+    else if (mode == "sync")
+        level = WF_GL_ERROR_CHECKS_SYNC;
+    else if (mode != "off")
+        log_error("invalid gl_error_checks mode %s, disabling checks", mode.c_str());
+
+    if (level > WAYFIRE_GL_ERROR_CHECKS)
+    {
+        log_info("gl_error_checks mode %s is not available in this build, "
+            "using %s", mode.c_str(), WAYFIRE_GL_ERROR_CHECKS_DEFAULT);
+        level = WAYFIRE_GL_ERROR_CHECKS;
+    }
+
+    gl_sync_error_checks = (level == WF_GL_ERROR_CHECKS_SYNC);
+    if (level == WF_GL_ERROR_CHECKS_CALLBACK &&
+        !enable_gl_debug_output(false))
+    {
+        log_info("KHR_debug is not supported, GL errors will not be reported");
+    }
+}
+
+/**
+ * A pool of framebuffers with attached textures, which are not used at the
+ * moment. Transient render targets (transformers, blur, postprocessing,
+ * workspace streams) are allocated and released often, so instead of
+ * destroying the GL objects, wf_framebuffer_base returns them to the pool,
+ * and takes a buffer with the needed size from it when possible.
+ *
+ * Buffers are bucketed by their exact size, because the users of
+ * wf_framebuffer_base sample the whole texture. When the pooled buffers
+ * take more memory than the budget (core/framebuffer_pool_size, in MiB),
+ * the least recently returned ones are destroyed.
+ */
+struct framebuffer_pool_t
+{
+    struct entry_t
+    {
+        GLuint fb, tex;
+        int width, height;
+    };
+
+    /* The most recently returned buffers are at the front */
+    std::list<entry_t> lru;
+    /* The entries of lru, bucketed by size */
+    std::multimap<std::pair<int, int>, std::list<entry_t>::iterator> buckets;
+
+    size_t pooled_bytes = 0;
+    wf_option budget_opt;
+
+    static size_t get_memory_size(int width, int height)
+    {
+        return 4ul * width * height;
+    }
+
+    size_t get_budget()
+    {
+        if (!budget_opt)
+        {
+            budget_opt = wf::get_core().config->get_section("core")->
+                get_option("framebuffer_pool_size", "64");
+        }
+
+        return std::max(budget_opt->as_cached_int(), 0) * 1024ul * 1024ul;
+    }
+
+    bool has_buffer(int width, int height)
+    {
+        return buckets.count({width, height});
+    }
+
+    /* Take a buffer with the given size from the pool.
+     * Returns false if there is no such buffer. */
+    bool take(int width, int height, GLuint& fb, GLuint& tex)
+    {
+        auto it = buckets.find({width, height});
+        if (it == buckets.end())
+            return false;
+
+        auto entry = it->second;
+        fb = entry->fb;
+        tex = entry->tex;
+
+        pooled_bytes -= get_memory_size(width, height);
+        buckets.erase(it);
+        lru.erase(entry);
+
+        return true;
+    }
+
+    /* Return a buffer to the pool */
+    void put(GLuint fb, GLuint tex, int width, int height)
+    {
+        lru.push_front({fb, tex, width, height});
+        buckets.insert({{width, height}, lru.begin()});
+        pooled_bytes += get_memory_size(width, height);
+
+        evict(get_budget());
+    }
+
+    /* Destroy the least recently used buffers until the pool fits in budget */
+    void evict(size_t budget)
+    {
+        while (pooled_bytes > budget && !lru.empty())
+        {
+            auto entry = std::prev(lru.end());
+            auto range = buckets.equal_range({entry->width, entry->height});
+            for (auto it = range.first; it != range.second; ++it)
+            {
+                if (it->second == entry)
+                {
+                    buckets.erase(it);
+                    break;
+                }
+            }
+
+            OpenGL::delete_framebuffer(entry->fb);
+            OpenGL::delete_texture(entry->tex);
+
+            pooled_bytes -= get_memory_size(entry->width, entry->height);
+            lru.erase(entry);
+        }
+    }
+} framebuffer_pool;
+
 namespace OpenGL
 {
+    namespace
+    {
+        /* A value of the shadow GL state, which is unknown after the state
+         * has been invalidated */
+        template<class T> struct cached_t
+        {
+            T value;
+            bool known = false;
+        };
+
+        /* Texture units whose bindings are tracked */
+        const int TRACKED_TEXTURE_UNITS = 4;
+
+        struct gl_state_t
+        {
+            cached_t<GLuint> program;
+            cached_t<GLenum> active_unit;
+            cached_t<GLuint> texture_2d[TRACKED_TEXTURE_UNITS];
+            cached_t<GLuint> texture_cube_map[TRACKED_TEXTURE_UNITS];
+            cached_t<GLuint> draw_framebuffer, read_framebuffer;
+
+            cached_t<bool> blend, scissor_test, depth_test, cull_face;
+            cached_t<std::pair<GLenum, GLenum>> blend_func;
+            cached_t<std::array<GLint, 4>> viewport, scissor;
+        } state;
+
+        state_statistics_t state_statistics;
+
+        /* Record the new value in the shadow state.
+         * Returns false if the state already had this value. */
+        template<class T> bool update_state(cached_t<T>& cached, const T& value)
+        {
+            ++state_statistics.state_changes;
+            if (cached.known && cached.value == value)
+            {
+                ++state_statistics.redundant_state_changes;
+                return false;
+            }
+
+            cached.value = value;
+            cached.known = true;
+            return true;
+        }
+
+        cached_t<bool> *get_cached_capability(GLenum cap)
+        {
+            switch (cap)
+            {
+                case GL_BLEND:
+                    return &state.blend;
+                case GL_SCISSOR_TEST:
+                    return &state.scissor_test;
+                case GL_DEPTH_TEST:
+                    return &state.depth_test;
+                case GL_CULL_FACE:
+                    return &state.cull_face;
+                default:
+                    return nullptr;
+            }
+        }
+
+        /* Returns the tracked binding of the target on the active unit, or
+         * null if it isn't tracked */
+        cached_t<GLuint> *get_cached_texture(GLenum target)
+        {
+            if (!state.active_unit.known)
+                return nullptr;
+
+            GLuint unit = state.active_unit.value - GL_TEXTURE0;
+            if (unit >= (GLuint)TRACKED_TEXTURE_UNITS)
+                return nullptr;
+
+            if (target == GL_TEXTURE_2D)
+                return &state.texture_2d[unit];
+            if (target == GL_TEXTURE_CUBE_MAP)
+                return &state.texture_cube_map[unit];
+
+            return nullptr;
+        }
+    }
+
+    void invalidate_state()
+    {
+        state = gl_state_t{};
+    }
+
+    state_statistics_t reset_state_statistics()
+    {
+        auto result = state_statistics;
+        state_statistics = {};
+        return result;
+    }
+
+    void use_program(GLuint program)
+    {
+        if (update_state(state.program, program))
+        {
+            GL_CALL(glUseProgram(program));
+        }
+    }
+
+    void active_texture(GLenum unit)
+    {
+        if (update_state(state.active_unit, unit))
+        {
+            GL_CALL(glActiveTexture(unit));
+        }
+    }
+
+    void bind_texture(GLenum target, GLuint tex)
+    {
+        auto cached = get_cached_texture(target);
+        if (cached)
+        {
+            if (update_state(*cached, tex))
+            {
+                GL_CALL(glBindTexture(target, tex));
+            }
+
+            return;
+        }
+
+        /* We don't know which unit is active, so forget the bindings of
+         * all units */
+        if (!state.active_unit.known)
+        {
+            for (int i = 0; i < TRACKED_TEXTURE_UNITS; i++)
+            {
+                state.texture_2d[i].known = false;
+                state.texture_cube_map[i].known = false;
+            }
+        }
+
+        ++state_statistics.state_changes;
+        GL_CALL(glBindTexture(target, tex));
+    }
+
+    void bind_framebuffer(GLenum target, GLuint fb)
+    {
+        if (target == GL_DRAW_FRAMEBUFFER)
+        {
+            if (update_state(state.draw_framebuffer, fb))
+            {
+                GL_CALL(glBindFramebuffer(target, fb));
+            }
+        } else if (target == GL_READ_FRAMEBUFFER)
+        {
+            if (update_state(state.read_framebuffer, fb))
+            {
+                GL_CALL(glBindFramebuffer(target, fb));
+            }
+        } else
+        {
+            /* GL_FRAMEBUFFER binds both */
+            auto& draw = state.draw_framebuffer;
+            auto& read = state.read_framebuffer;
+
+            ++state_statistics.state_changes;
+            if (draw.known && read.known && draw.value == fb && read.value == fb)
+            {
+                ++state_statistics.redundant_state_changes;
+                return;
+            }
+
+            draw = {fb, true};
+            read = {fb, true};
+            GL_CALL(glBindFramebuffer(target, fb));
+        }
+    }
+
+    static void set_capability(GLenum cap, bool enabled)
+    {
+        auto cached = get_cached_capability(cap);
+        if (cached && !update_state(*cached, enabled))
+            return;
+
+        if (!cached)
+            ++state_statistics.state_changes;
+
+        if (enabled)
+        {
+            GL_CALL(glEnable(cap));
+        } else
+        {
+            GL_CALL(glDisable(cap));
+        }
+    }
+
+    void enable(GLenum cap)
+    {
+        set_capability(cap, true);
+    }
+
+    void disable(GLenum cap)
+    {
+        set_capability(cap, false);
+    }
+
+    void blend_func(GLenum sfactor, GLenum dfactor)
+    {
+        if (update_state(state.blend_func, {sfactor, dfactor}))
+        {
+            GL_CALL(glBlendFunc(sfactor, dfactor));
+        }
+    }
+
+    void viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        if (update_state(state.viewport, {x, y, width, height}))
+        {
+            GL_CALL(glViewport(x, y, width, height));
+        }
+    }
+
+    void scissor(GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        if (update_state(state.scissor, {x, y, width, height}))
+        {
+            GL_CALL(glScissor(x, y, width, height));
+        }
+    }
+
+    void delete_texture(GLuint tex)
+    {
+        for (int i = 0; i < TRACKED_TEXTURE_UNITS; i++)
+        {
+            for (auto cached : {&state.texture_2d[i], &state.texture_cube_map[i]})
+            {
+                if (cached->known && cached->value == tex)
+                    cached->value = 0;
+            }
+        }
+
+        GL_CALL(glDeleteTextures(1, &tex));
+    }
+
+    void delete_framebuffer(GLuint fb)
+    {
+        for (auto cached : {&state.draw_framebuffer, &state.read_framebuffer})
+        {
+            if (cached->known && cached->value == fb)
+                cached->value = 0;
+        }
+
+        GL_CALL(glDeleteFramebuffers(1, &fb));
+    }
+
     /* Different Context is kept for each output */
     /* Each of the following functions uses the currently bound context */
     struct
@@ -47,6 +447,9 @@ namespace OpenGL
 
         GLuint mvpID, colorID;
         GLuint position, uvPosition;
+
+        /* Vertex buffer for texture batches */
+        wf_gpu_buffer batch_buffer{GL_ARRAY_BUFFER, WF_BUFFER_STREAMING};
     } program;
 
     GLuint compile_shader_from_file(std::string path, std::string source, GLuint type)
@@ -77,28 +480,46 @@ namespace OpenGL
         return compile_shader_from_file("internal", source, type);
     }
 
-    GLuint load_shader(std::string path, GLuint type)
+    /* Read the whole file to contents, returns false on failure */
+    static bool read_shader_file(std::string path, std::string& contents)
     {
         std::fstream file(path, std::ios::in);
         if(!file.is_open())
         {
             log_error("cannot open shader file %s", path.c_str());
-            return -1;
+            return false;
         }
 
-        std::string str, line;
+        std::string line;
         while(std::getline(file, line))
-            str += line, str += '\n';
+            contents += line, contents += '\n';
+
+        return true;
+    }
+
+    GLuint load_shader(std::string path, GLuint type)
+    {
+        std::string str;
+        if (!read_shader_file(path, str))
+            return -1;
 
         return compile_shader(str.c_str(), type);
     }
 
-    GLuint create_program_from_shaders(GLuint vertex_shader,
-        GLuint fragment_shader)
+    /* Link a program from the given shaders, and delete the shaders.
+     * If retrievable is set, the driver is asked to keep the program binary,
+     * which needs GLES 3.0 */
+    static GLuint link_program(GLuint vertex_shader, GLuint fragment_shader,
+        bool retrievable)
     {
         auto result_program = GL_CALL(glCreateProgram());
         GL_CALL(glAttachShader(result_program, vertex_shader));
         GL_CALL(glAttachShader(result_program, fragment_shader));
+        if (retrievable && context_supports_gles3())
+        {
+            GL_CALL(glProgramParameteri(result_program,
+                    GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+        }
         GL_CALL(glLinkProgram(result_program));
 
         /* won't be really deleted until program is deleted as well */
@@ -108,26 +529,317 @@ namespace OpenGL
         return result_program;
     }
 
+    static bool is_program_linked(GLuint program)
+    {
+        GLint status = GL_FALSE;
+        GL_CALL(glGetProgramiv(program, GL_LINK_STATUS, &status));
+        return status == GL_TRUE;
+    }
+
+    namespace
+    {
+        /* 64-bit FNV-1a, a hash which is stable across runs */
+        uint64_t hash_string(const std::string& str,
+            uint64_t hash = 14695981039346656037ull)
+        {
+            for (unsigned char c : str)
+            {
+                hash ^= c;
+                hash *= 1099511628211ull;
+            }
+
+            return hash;
+        }
+
+        /* Create the directory and its parents, like mkdir -p */
+        bool make_directories(const std::string& path)
+        {
+            for (size_t i = 1; i <= path.size(); i++)
+            {
+                if (i < path.size() && path[i] != '/')
+                    continue;
+
+                auto dir = path.substr(0, i);
+                if (mkdir(dir.c_str(), 0700) < 0 && errno != EEXIST)
+                    return false;
+            }
+
+            return true;
+        }
+
+        /**
+         * Programs created with create_program_from_source() and
+         * create_program() are shared by everyone who creates a program with
+         * the same sources, for ex. the instances of a plugin on different
+         * outputs, and are reference counted.
+         *
+         * Linked programs are also stored on disk with glGetProgramBinary(),
+         * in $XDG_CACHE_HOME/wayfire/shaders, so that they don't have to be
+         * compiled again after a restart. The binaries are named after the
+         * hash of the sources and of the driver, and contain the driver
+         * string, so that they are not used after a driver update.
+         */
+        struct program_cache_t
+        {
+            struct entry_t
+            {
+                GLuint id;
+                int refcount;
+            };
+
+            /* Keyed by the vertex and the fragment source */
+            std::map<std::string, entry_t> programs;
+            std::map<GLuint, std::map<std::string, entry_t>::iterator> by_id;
+
+            /* Vendor, renderer and version of the GL driver */
+            std::string driver;
+            /* Empty if binaries are not supported or there is no cache dir */
+            std::string cache_dir;
+
+            static constexpr uint32_t binary_magic = 0x42504657; // WFPB
+
+            void init()
+            {
+                auto get_string = [] (GLenum name) -> std::string
+                {
+                    auto str = (const char*)glGetString(name);
+                    return str ? str : "";
+                };
+
+                driver = get_string(GL_VENDOR) + ";" +
+                    get_string(GL_RENDERER) + ";" + get_string(GL_VERSION);
+
+                /* Program binaries are core in GLES 3.0 */
+                GLint formats = 0;
+                if (context_supports_gles3())
+                {
+                    GL_CALL(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS,
+                            &formats));
+                }
+
+                if (formats <= 0)
+                {
+                    log_info("program binaries are not supported, "
+                        "shaders will not be cached on disk");
+                    return;
+                }
+
+                std::string base = nonull(getenv("XDG_CACHE_HOME"));
+                if (base == "nil" || base.empty() || base[0] != '/')
+                {
+                    std::string home = nonull(getenv("HOME"));
+                    if (home == "nil")
+                        return;
+
+                    base = home + "/.cache";
+                }
+
+                cache_dir = base + "/wayfire/shaders";
+            }
+
+            std::string get_binary_path(const std::string& key)
+            {
+                char name[32];
+                snprintf(name, sizeof(name), "/%016llx.bin",
+                    (unsigned long long)hash_string(key, hash_string(driver)));
+
+                return cache_dir + name;
+            }
+
+            /* Returns 0 if there is no valid binary for the key */
+            GLuint load_binary(const std::string& key)
+            {
+                std::ifstream file(get_binary_path(key), std::ios::binary);
+                if (!file)
+                    return 0;
+
+                file.seekg(0, std::ios::end);
+                std::streamoff file_size = file.tellg();
+                file.seekg(0, std::ios::beg);
+
+                uint32_t magic = 0, driver_length = 0, length = 0;
+                GLenum format = 0;
+                file.read((char*)&magic, sizeof(magic));
+                file.read((char*)&driver_length, sizeof(driver_length));
+                if (!file || magic != binary_magic || driver_length != driver.size())
+                    return 0;
+
+                std::string binary_driver(driver_length, '\0');
+                file.read(&binary_driver[0], driver_length);
+                file.read((char*)&format, sizeof(format));
+                file.read((char*)&length, sizeof(length));
+                if (!file || binary_driver != driver)
+                    return 0;
+
+                /* A truncated or corrupted file must not make us allocate
+                 * more than the rest of the file */
+                if (length == 0 || length > file_size - file.tellg())
+                    return 0;
+
+                std::vector<char> binary(length);
+                file.read(binary.data(), length);
+                if (!file)
+                    return 0;
+
+                auto program = GL_CALL(glCreateProgram());
+                GL_CALL(glProgramBinary(program, format, binary.data(), length));
+                if (!is_program_linked(program))
+                {
+                    /* The driver rejected the binary, for ex. because of an
+                     * update which didn't change the version string */
+                    GL_CALL(glDeleteProgram(program));
+                    return 0;
+                }
+
+                return program;
+            }
+
+            void save_binary(const std::string& key, GLuint program)
+            {
+                GLint length = 0;
+                GL_CALL(glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length));
+                if (length <= 0)
+                    return;
+
+                std::vector<char> binary(length);
+                GLenum format;
+                GL_CALL(glGetProgramBinary(program, length, NULL, &format,
+                        binary.data()));
+
+                if (!make_directories(cache_dir))
+                {
+                    log_error("failed to create shader cache directory %s",
+                        cache_dir.c_str());
+                    cache_dir.clear();
+                    return;
+                }
+
+                /* Write to a temporary file first, so that other instances
+                 * never see a partially written binary */
+                auto path = get_binary_path(key);
+                auto tmp_path = path + "." + std::to_string(getpid());
+
+                std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+                uint32_t driver_length = driver.size();
+                uint32_t binary_length = length;
+                file.write((const char*)&binary_magic, sizeof(binary_magic));
+                file.write((const char*)&driver_length, sizeof(driver_length));
+                file.write(driver.data(), driver_length);
+                file.write((const char*)&format, sizeof(format));
+                file.write((const char*)&binary_length, sizeof(binary_length));
+                file.write(binary.data(), binary_length);
+                file.close();
+
+                if (!file || std::rename(tmp_path.c_str(), path.c_str()) < 0)
+                {
+                    log_error("failed to write shader cache file %s", path.c_str());
+                    std::remove(tmp_path.c_str());
+                }
+            }
+
+            GLuint create(const std::string& vertex_source,
+                const std::string& frag_source)
+            {
+                auto key = vertex_source + '\0' + frag_source;
+                auto it = programs.find(key);
+                if (it != programs.end())
+                {
+                    ++it->second.refcount;
+                    return it->second.id;
+                }
+
+                GLuint id = cache_dir.empty() ? 0 : load_binary(key);
+                if (!id)
+                {
+                    id = link_program(
+                        compile_shader(vertex_source, GL_VERTEX_SHADER),
+                        compile_shader(frag_source, GL_FRAGMENT_SHADER),
+                        !cache_dir.empty());
+
+                    /* Don't share broken programs */
+                    if (!is_program_linked(id))
+                    {
+                        log_error("failed to link program");
+                        return id;
+                    }
+
+                    if (!cache_dir.empty())
+                        save_binary(key, id);
+                }
+
+                it = programs.insert({key, {id, 1}}).first;
+                by_id[id] = it;
+                return id;
+            }
+
+            void destroy(GLuint id)
+            {
+                auto it = by_id.find(id);
+                if (it == by_id.end())
+                {
+                    GL_CALL(glDeleteProgram(id));
+                    return;
+                }
+
+                if (--it->second->second.refcount > 0)
+                    return;
+
+                GL_CALL(glDeleteProgram(id));
+                programs.erase(it->second);
+                by_id.erase(it);
+            }
+        } program_cache;
+    }
+
     GLuint create_program_from_source(std::string vertex_source,
         std::string frag_source)
     {
-        return create_program_from_shaders(
-            compile_shader(vertex_source, GL_VERTEX_SHADER),
-            compile_shader(frag_source, GL_FRAGMENT_SHADER));
+        return program_cache.create(vertex_source, frag_source);
     }
 
     GLuint create_program(std::string vertex_path, std::string frag_path)
     {
-        return create_program_from_shaders(
-            load_shader(vertex_path, GL_VERTEX_SHADER),
-            load_shader(frag_path, GL_FRAGMENT_SHADER));
+        std::string vertex_source, frag_source;
+        if (!read_shader_file(vertex_path, vertex_source) ||
+            !read_shader_file(frag_path, frag_source))
+        {
+            return -1;
+        }
+
+        return program_cache.create(vertex_source, frag_source);
+    }
+
+    void destroy_program(GLuint program)
+    {
+        program_cache.destroy(program);
+    }
+
+    namespace
+    {
+        bool supports_gles3 = false;
+    }
+
+    bool context_supports_gles3()
+    {
+        return supports_gles3;
     }
 
     void init()
     {
         render_begin();
 
-        // enable_gl_synchronuous_debug()
+        auto version = (const char*)glGetString(GL_VERSION);
+        int major = 0;
+        supports_gles3 = version &&
+            std::sscanf(version, "OpenGL ES %d", &major) == 1 && major >= 3;
+        if (!supports_gles3)
+        {
+            log_info("GLES 3.0 is not supported, rendering with GLES 2.0 "
+                "(version %s)", nonull(version));
+        }
+
+        setup_gl_error_checks();
+        program_cache.init();
         std::string shader_path = INSTALL_PREFIX "/share/wayfire/shaders";
         program.id = create_program(
             shader_path + "/vertex.glsl", shader_path + "/frag.glsl");
@@ -143,7 +855,9 @@ namespace OpenGL
     void fini()
     {
         render_begin();
-        GL_CALL(glDeleteProgram(program.id));
+        destroy_program(program.id);
+        program.batch_buffer.release();
+        framebuffer_pool.evict(0);
         render_end();
     }
 
@@ -166,57 +880,272 @@ namespace OpenGL
         const gl_geometry& g, const gl_geometry& texg,
         glm::mat4 model, glm::vec4 color, uint32_t bits)
     {
-        GL_CALL(glUseProgram(program.id));
+        texture_batch_t batch{tex, model, color, bits};
+        batch.add_quad(g, texg);
+        batch.flush();
+    }
+
+    texture_batch_t::texture_batch_t(GLuint tex, glm::mat4 transform,
+        glm::vec4 color, uint32_t bits)
+        : tex(tex), transform(transform), color(color), bits(bits) { }
+
+    size_t texture_batch_t::size() const
+    {
+        return quads.size();
+    }
 
+    void texture_batch_t::push_quad(const gl_geometry& g,
+        const gl_geometry& texg, float s1, float s2, float t1, float t2)
+    {
         gl_geometry final_g = g;
         if (bits & TEXTURE_TRANSFORM_INVERT_Y)
             std::swap(final_g.y1, final_g.y2);
         if (bits & TEXTURE_TRANSFORM_INVERT_X)
             std::swap(final_g.x1, final_g.x2);
 
-        GLfloat vertexData[] = {
-            final_g.x1, final_g.y2,
-            final_g.x2, final_g.y2,
-            final_g.x2, final_g.y1,
-            final_g.x1, final_g.y1,
+        /* s goes from x1 to x2, t goes from y2 to y1 */
+        gl_geometry uv = {0.0f, 1.0f, 1.0f, 0.0f};
+        if (bits & TEXTURE_USE_TEX_GEOMETRY)
+            uv = texg;
+
+        auto lerp = [] (float a, float b, float k) { return a + (b - a) * k; };
+        auto make_vertex = [&] (float s, float t) -> vertex_t
+        {
+            return {
+                lerp(final_g.x1, final_g.x2, s), lerp(final_g.y2, final_g.y1, t),
+                lerp(uv.x1, uv.x2, s), lerp(uv.y2, uv.y1, t),
+            };
         };
 
-        GLfloat coordData[] = {
-            0.0f, 0.0f,
-            1.0f, 0.0f,
-            1.0f, 1.0f,
-            0.0f, 1.0f,
+        auto v1 = make_vertex(s1, t1), v2 = make_vertex(s2, t1),
+             v3 = make_vertex(s2, t2), v4 = make_vertex(s1, t2);
+        vertices.insert(vertices.end(), {v1, v2, v3, v1, v3, v4});
+    }
+
+    bool texture_batch_t::clip_on_cpu(const gl_geometry& g,
+        const wf_framebuffer_base& fb, wlr_box clip,
+        float& s1, float& s2, float& t1, float& t2)
+    {
+        /* Projective transforms don't map the quad to a rectangle */
+        if (transform[0][3] != 0 || transform[1][3] != 0 || transform[3][3] == 0)
+            return false;
+
+        gl_geometry final_g = g;
+        if (bits & TEXTURE_TRANSFORM_INVERT_Y)
+            std::swap(final_g.y1, final_g.y2);
+        if (bits & TEXTURE_TRANSFORM_INVERT_X)
+            std::swap(final_g.x1, final_g.x2);
+
+        /* Project a point of the quad to GL window coordinates */
+        auto project = [&] (float x, float y)
+        {
+            glm::vec4 v = transform * glm::vec4{x, y, 0, 1};
+            return glm::vec2{
+                (v.x / v.w + 1) / 2 * fb.viewport_width,
+                (v.y / v.w + 1) / 2 * fb.viewport_height};
+        };
+
+        auto origin = project(final_g.x1, final_g.y2);
+        auto ds = project(final_g.x2, final_g.y2) - origin;
+        auto dt = project(final_g.x1, final_g.y1) - origin;
+
+        const float eps = 1e-3;
+        bool s_is_x;
+        if (std::abs(ds.y) < eps && std::abs(dt.x) < eps)
+            s_is_x = true;
+        else if (std::abs(ds.x) < eps && std::abs(dt.y) < eps)
+            s_is_x = false;
+        else
+            return false; // rotated
+
+        float clip_x1 = clip.x, clip_x2 = clip.x + clip.width;
+        float clip_y1 = fb.viewport_height - clip.y - clip.height;
+        float clip_y2 = clip_y1 + clip.height;
+
+        /* Find the range of the parameter in which its coordinate is inside
+         * [c1, c2], where the coordinate is start + param * delta */
+        auto clip_range = [] (float start, float delta, float c1, float c2,
+            float& p1, float& p2)
+        {
+            if (delta == 0)
+            {
+                /* Degenerate quad, nothing to render */
+                p1 = p2 = 0;
+                return;
+            }
+
+            float a = (c1 - start) / delta, b = (c2 - start) / delta;
+            p1 = std::max(0.0f, std::min(a, b));
+            p2 = std::min(1.0f, std::max(a, b));
         };
 
-        if (bits & TEXTURE_USE_TEX_GEOMETRY) {
-            coordData[0] = texg.x1; coordData[1] = texg.y2;
-            coordData[2] = texg.x2; coordData[3] = texg.y2;
-            coordData[4] = texg.x2; coordData[5] = texg.y1;
-            coordData[6] = texg.x1; coordData[7] = texg.y1;
+        if (s_is_x)
+        {
+            clip_range(origin.x, ds.x, clip_x1, clip_x2, s1, s2);
+            clip_range(origin.y, dt.y, clip_y1, clip_y2, t1, t2);
+        } else
+        {
+            clip_range(origin.y, ds.y, clip_y1, clip_y2, s1, s2);
+            clip_range(origin.x, dt.x, clip_x1, clip_x2, t1, t2);
         }
 
-        GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
-        GL_CALL(glActiveTexture(GL_TEXTURE0));
+        return true;
+    }
+
+    void texture_batch_t::add_quad(const gl_geometry& g, const gl_geometry& texg)
+    {
+        push_quad(g, texg, 0, 1, 0, 1);
+        quads.push_back({CLIP_NONE, {0, 0, 0, 0}});
+    }
+
+    void texture_batch_t::add_quad(const gl_geometry& g, const gl_geometry& texg,
+        const wf_framebuffer_base& fb, wlr_box clip)
+    {
+        if (clip.width <= 0 || clip.height <= 0)
+            return;
+
+        target = &fb;
 
-        GL_CALL(glVertexAttribPointer(program.position, 2, GL_FLOAT, GL_FALSE, 0, vertexData));
-        GL_CALL(glEnableVertexAttribArray(program.position));
+        float s1, s2, t1, t2;
+        if (!clip_on_cpu(g, fb, clip, s1, s2, t1, t2))
+        {
+            push_quad(g, texg, 0, 1, 0, 1);
+            quads.push_back({CLIP_SCISSOR, clip});
+            return;
+        }
 
-        GL_CALL(glVertexAttribPointer(program.uvPosition, 2, GL_FLOAT, GL_FALSE, 0, coordData));
-        GL_CALL(glEnableVertexAttribArray(program.uvPosition));
+        /* Completely clipped away */
+        if (s1 >= s2 || t1 >= t2)
+            return;
 
-        GL_CALL(glUniformMatrix4fv(program.mvpID, 1, GL_FALSE, &model[0][0]));
+        push_quad(g, texg, s1, s2, t1, t2);
+        quads.push_back({CLIP_GEOMETRY, clip});
+    }
+
+    void texture_batch_t::add_quad(const gl_geometry& g, const gl_geometry& texg,
+        const wf_framebuffer& fb, const wf_region& damage)
+    {
+        for (const auto& rect : damage)
+        {
+            add_quad(g, texg, fb, fb.framebuffer_box_from_damage_box(
+                wlr_box_from_pixman_box(rect)));
+        }
+    }
+
+    void texture_batch_t::flush()
+    {
+        if (quads.empty())
+            return;
+
+        use_program(program.id);
+
+        active_texture(GL_TEXTURE0);
+        bind_texture(GL_TEXTURE_2D, tex);
+
+        auto& buffer = program.batch_buffer;
+        size_t offset = buffer.upload(vertices.data(),
+            vertices.size() * sizeof(vertex_t));
+
+        buffer.bind();
+        buffer.set_attribute(program.position, 2, sizeof(vertex_t),
+            offset + offsetof(vertex_t, x));
+        buffer.set_attribute(program.uvPosition, 2, sizeof(vertex_t),
+            offset + offsetof(vertex_t, u));
+
+        GL_CALL(glUniformMatrix4fv(program.mvpID, 1, GL_FALSE, &transform[0][0]));
         GL_CALL(glUniform4fv(program.colorID, 1, &color[0]));
 
-        GL_CALL(glEnable(GL_BLEND));
-        GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
-        GL_CALL(glDrawArrays(GL_TRIANGLE_FAN, 0, 4));
+        enable(GL_BLEND);
+        blend_func(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+        /* Render runs of quads which can share the same scissor box */
+        const int vertices_per_quad = 6;
+        size_t i = 0;
+        while (i < quads.size())
+        {
+            auto mode = quads[i].mode;
+            auto clip = quads[i].clip;
+
+            size_t j = i + 1;
+            for (; j < quads.size() && quads[j].mode == mode; j++)
+            {
+                if (mode == CLIP_SCISSOR && quads[j].clip != clip)
+                    break;
+
+                /* Quads cut on the CPU can use any scissor box which contains
+                 * all of their clip boxes */
+                if (mode == CLIP_GEOMETRY)
+                {
+                    int x2 = std::max(clip.x + clip.width,
+                        quads[j].clip.x + quads[j].clip.width);
+                    int y2 = std::max(clip.y + clip.height,
+                        quads[j].clip.y + quads[j].clip.height);
+                    clip.x = std::min(clip.x, quads[j].clip.x);
+                    clip.y = std::min(clip.y, quads[j].clip.y);
+                    clip.width = x2 - clip.x;
+                    clip.height = y2 - clip.y;
+                }
+            }
+
+            if (mode != CLIP_NONE)
+                target->scissor(clip);
+
+            GL_CALL(glDrawArrays(GL_TRIANGLES, i * vertices_per_quad,
+                    (j - i) * vertices_per_quad));
+            i = j;
+        }
+
+        /* wlroots uses client-side vertex arrays, so we must not leave our
+         * buffer bound */
+        buffer.unbind();
+
+        vertices.clear();
+        quads.clear();
+        target = nullptr;
+    }
+
+    namespace
+    {
+        struct render_target_t
+        {
+            int32_t width, height;
+            uint32_t fb;
+        };
+
+        /* The targets of the render_begin() calls which haven't been ended
+         * yet. The wlroots renderer is begun only once for all of them, and
+         * begun again only when the viewport size changes, since wlroots
+         * uses it to invert scissor boxes. */
+        std::vector<render_target_t> render_targets;
 
-        GL_CALL(glDisableVertexAttribArray(program.uvPosition));
-        GL_CALL(glDisableVertexAttribArray(program.position));
+        void push_render_target(render_target_t target)
+        {
+            size_t capacity = render_targets.capacity();
+            render_targets.push_back(target);
+            if (render_targets.capacity() != capacity)
+                wf_note_cache_growth();
+        }
+
+        void begin_renderer(int32_t width, int32_t height)
+        {
+            wlr_renderer_begin(wf::get_core_impl().renderer, width, height);
+        }
+
+        void end_renderer()
+        {
+            wlr_renderer_end(wf::get_core_impl().renderer);
+        }
     }
 
     void render_begin()
     {
+        /* Nested in another render_begin(), the context is already current */
+        if (!render_targets.empty())
+        {
+            push_render_target(render_targets.back());
+            return;
+        }
+
         /* No real reason for 10, 10, 0 but it doesn't matter */
         render_begin(10, 10, 0);
     }
@@ -228,12 +1157,31 @@ namespace OpenGL
 
     void render_begin(int32_t viewport_width, int32_t viewport_height, uint32_t fb)
     {
-        if (!current_output && !wlr_egl_is_current(wf::get_core_impl().egl))
-            wlr_egl_make_current(wf::get_core_impl().egl, EGL_NO_SURFACE, NULL);
+        if (render_targets.empty())
+        {
+            if (!current_output && !wlr_egl_is_current(wf::get_core_impl().egl))
+                wlr_egl_make_current(wf::get_core_impl().egl, EGL_NO_SURFACE, NULL);
 
-        wlr_renderer_begin(wf::get_core_impl().renderer,
-            viewport_width, viewport_height);
-        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, fb));
+            begin_renderer(viewport_width, viewport_height);
+            invalidate_state();
+        } else
+        {
+            auto& outer = render_targets.back();
+            if (outer.width != viewport_width || outer.height != viewport_height)
+            {
+                end_renderer();
+                begin_renderer(viewport_width, viewport_height);
+            }
+
+            /* Restore the state which wlr_renderer_begin() sets up */
+            invalidate_state();
+            viewport(0, 0, viewport_width, viewport_height);
+            enable(GL_BLEND);
+            blend_func(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        }
+
+        push_render_target({viewport_width, viewport_height, fb});
+        bind_framebuffer(GL_FRAMEBUFFER, fb);
     }
 
     void clear(wf_color col, uint32_t mask)
@@ -244,14 +1192,87 @@ namespace OpenGL
 
     void render_end()
     {
-        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
-        wlr_renderer_scissor(wf::get_core().renderer, NULL);
-        wlr_renderer_end(wf::get_core().renderer);
+        if (render_targets.empty())
+        {
+            log_error("render_end() called without render_begin()");
+            return;
+        }
+
+        auto target = render_targets.back();
+        render_targets.pop_back();
+
+        if (render_targets.empty())
+        {
+            bind_framebuffer(GL_FRAMEBUFFER, 0);
+            wlr_renderer_scissor(wf::get_core().renderer, NULL);
+            end_renderer();
+            invalidate_state();
+            return;
+        }
+
+        /* Go back to the target of the enclosing render_begin() */
+        auto& outer = render_targets.back();
+        if (outer.width != target.width || outer.height != target.height)
+        {
+            end_renderer();
+            begin_renderer(outer.width, outer.height);
+        }
+
+        invalidate_state();
+        disable(GL_SCISSOR_TEST);
+        viewport(0, 0, outer.width, outer.height);
+        enable(GL_BLEND);
+        blend_func(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        bind_framebuffer(GL_FRAMEBUFFER, outer.fb);
+    }
+
+    render_pass_t::render_pass_t(const wf_framebuffer_base& fb)
+    {
+        render_begin(fb);
+    }
+
+    render_pass_t::~render_pass_t()
+    {
+        render_end();
     }
 }
 
 bool wf_framebuffer_base::allocate(int width, int height)
 {
+    /* Special case: fb = 0. This occurs in the default workspace streams,
+     * they are not pooled. */
+    bool is_allocated = (fb != (uint32_t)-1 && tex != (uint32_t)-1);
+    bool is_empty = (fb == (uint32_t)-1 && tex == (uint32_t)-1);
+    bool size_changed = (width != viewport_width || height != viewport_height);
+
+    /* When resizing, swap the buffer with a pooled one which already has the
+     * right size. Without one, the texture is resized in place below, so
+     * that continuous resizing doesn't fill the pool with unused sizes. */
+    if (is_allocated && fb != 0 && size_changed &&
+        framebuffer_pool.has_buffer(width, height))
+    {
+        framebuffer_pool.put(fb, tex, viewport_width, viewport_height);
+        reset();
+        is_empty = true;
+    }
+
+    if (is_empty && framebuffer_pool.take(width, height, fb, tex))
+    {
+        /* The previous user may have changed the sampling parameters */
+        OpenGL::bind_texture(GL_TEXTURE_2D, tex);
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+        OpenGL::bind_texture(GL_TEXTURE_2D, 0);
+
+        viewport_width = width;
+        viewport_height = height;
+
+        /* The contents are whatever the previous user left */
+        return true;
+    }
+
     bool first_allocate = false;
     if (fb == (uint32_t)-1)
     {
@@ -264,7 +1285,7 @@ bool wf_framebuffer_base::allocate(int width, int height)
 
         first_allocate = true;
         GL_CALL(glGenTextures(1, &tex));
-        GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
+        OpenGL::bind_texture(GL_TEXTURE_2D, tex);
         GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
         GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
         GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
@@ -278,7 +1299,7 @@ bool wf_framebuffer_base::allocate(int width, int height)
         if (first_allocate || width != viewport_width || height != viewport_height)
         {
             is_resize = true;
-            GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
+            OpenGL::bind_texture(GL_TEXTURE_2D, tex);
             GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height,
                     0, GL_RGBA, GL_UNSIGNED_BYTE, 0));
         }
@@ -286,8 +1307,8 @@ bool wf_framebuffer_base::allocate(int width, int height)
 
     if (first_allocate)
     {
-        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, fb));
-        GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
+        OpenGL::bind_framebuffer(GL_FRAMEBUFFER, fb);
+        OpenGL::bind_texture(GL_TEXTURE_2D, tex);
         GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
                 GL_TEXTURE_2D, tex, 0));
     }
@@ -305,8 +1326,8 @@ bool wf_framebuffer_base::allocate(int width, int height)
     viewport_width = width;
     viewport_height = height;
 
-    GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
-    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    OpenGL::bind_texture(GL_TEXTURE_2D, 0);
+    OpenGL::bind_framebuffer(GL_FRAMEBUFFER, 0);
 
     return is_resize || first_allocate;
 }
@@ -340,28 +1361,33 @@ wf_framebuffer_base& wf_framebuffer_base::operator = (wf_framebuffer_base&& othe
 
 void wf_framebuffer_base::bind() const
 {
-    GL_CALL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fb));
-    GL_CALL(glViewport(0, 0, viewport_width, viewport_height));
+    OpenGL::bind_framebuffer(GL_DRAW_FRAMEBUFFER, fb);
+    OpenGL::viewport(0, 0, viewport_width, viewport_height);
 }
 
 void wf_framebuffer_base::scissor(wlr_box box) const
 {
-    GL_CALL(glEnable(GL_SCISSOR_TEST));
-    GL_CALL(glScissor(box.x, viewport_height - box.y - box.height,
-                      box.width, box.height));
+    OpenGL::enable(GL_SCISSOR_TEST);
+    OpenGL::scissor(box.x, viewport_height - box.y - box.height,
+        box.width, box.height);
 }
 
 void wf_framebuffer_base::release()
 {
-    if (fb != uint32_t(-1) && fb != 0)
+    /* Keep the buffer for the next allocation with the same size */
+    if (fb != uint32_t(-1) && fb != 0 && tex != uint32_t(-1) &&
+        viewport_width > 0 && viewport_height > 0)
     {
-        GL_CALL(glDeleteFramebuffers(1, &fb));
+        framebuffer_pool.put(fb, tex, viewport_width, viewport_height);
+        reset();
+        return;
     }
 
+    if (fb != uint32_t(-1) && fb != 0)
+        OpenGL::delete_framebuffer(fb);
+
     if (tex != uint32_t(-1) && (fb != 0 || tex != 0))
-    {
-        GL_CALL(glDeleteTextures(1, &tex));
-    }
+        OpenGL::delete_texture(tex);
 
     reset();
 }
@@ -373,6 +1399,208 @@ void wf_framebuffer_base::reset()
     viewport_width = viewport_height = 0;
 }
 
+wf_gpu_buffer::wf_gpu_buffer(GLenum target, wf_gpu_buffer_usage usage)
+    : target(target), usage(usage) { }
+
+void wf_gpu_buffer::copy_state(wf_gpu_buffer&& other)
+{
+    this->buffer = other.buffer;
+    this->vao = other.vao;
+    this->target = other.target;
+    this->usage = other.usage;
+    this->capacity = other.capacity;
+    this->used = other.used;
+    this->enabled_attributes = other.enabled_attributes;
+
+    other.buffer = other.vao = -1;
+    other.capacity = other.used = 0;
+    other.enabled_attributes = 0;
+}
+
+wf_gpu_buffer::wf_gpu_buffer(wf_gpu_buffer&& other)
+{
+    copy_state(std::move(other));
+}
+
+wf_gpu_buffer& wf_gpu_buffer::operator = (wf_gpu_buffer&& other)
+{
+    if (this == &other)
+        return *this;
+
+    release();
+    copy_state(std::move(other));
+
+    return *this;
+}
+
+size_t wf_gpu_buffer::upload(const void *data, size_t size)
+{
+    create_and_bind();
+    if (size == 0)
+        return 0;
+
+    switch (usage)
+    {
+        case WF_BUFFER_PERSISTENT:
+            if (size > capacity)
+            {
+                GL_CALL(glBufferData(target, size, data, GL_STATIC_DRAW));
+                capacity = size;
+            } else
+            {
+                GL_CALL(glBufferSubData(target, 0, size, data));
+            }
+
+            return 0;
+
+        case WF_BUFFER_ORPHANED:
+            /* Passing new data to glBufferData() orphans the old storage */
+            GL_CALL(glBufferData(target, size, data, GL_STREAM_DRAW));
+            capacity = size;
+            return 0;
+
+        case WF_BUFFER_STREAMING:
+            break;
+    }
+
+    ensure_space(size);
+
+    /* The range after used hasn't been used since the last orphaning, so
+     * there is no need to synchronize with pending draws. GLES 2.0 can't map
+     * buffers, but the driver can still skip the synchronization there. */
+    void *ptr = nullptr;
+    if (OpenGL::context_supports_gles3())
+    {
+        ptr = GL_CALL(glMapBufferRange(target, used, size, GL_MAP_WRITE_BIT |
+                GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+    }
+
+    if (ptr)
+    {
+        std::memcpy(ptr, data, size);
+        GL_CALL(glUnmapBuffer(target));
+    } else
+    {
+        GL_CALL(glBufferSubData(target, used, size, data));
+    }
+
+    size_t offset = used;
+    used += size;
+
+    return offset;
+}
+
+void wf_gpu_buffer::create_and_bind()
+{
+    if (buffer == (uint32_t)-1)
+    {
+        GL_CALL(glGenBuffers(1, &buffer));
+        if (target == GL_ARRAY_BUFFER && OpenGL::context_supports_gles3())
+        {
+            GL_CALL(glGenVertexArrays(1, &vao));
+        }
+    }
+
+    GL_CALL(glBindBuffer(target, buffer));
+}
+
+/* Keep the offsets in streaming buffers aligned, so that any attribute type
+ * can start there */
+static const size_t gpu_buffer_alignment = 16;
+
+void wf_gpu_buffer::ensure_space(size_t size)
+{
+    used = (used + gpu_buffer_alignment - 1) /
+        gpu_buffer_alignment * gpu_buffer_alignment;
+    if (used + size > capacity)
+    {
+        const size_t min_capacity = 64 * 1024;
+        capacity = std::max({min_capacity, 2 * capacity, size});
+        GL_CALL(glBufferData(target, capacity, NULL, GL_STREAM_DRAW));
+        used = 0;
+    }
+}
+
+void wf_gpu_buffer::reserve(size_t size, int uploads)
+{
+    if (usage != WF_BUFFER_STREAMING)
+        return;
+
+    create_and_bind();
+    ensure_space(size + uploads * gpu_buffer_alignment);
+}
+
+void wf_gpu_buffer::bind() const
+{
+    if (vao != (uint32_t)-1)
+    {
+        GL_CALL(glBindVertexArray(vao));
+    }
+
+    GL_CALL(glBindBuffer(target, buffer));
+}
+
+void wf_gpu_buffer::unbind() const
+{
+    if (vao != (uint32_t)-1)
+    {
+        GL_CALL(glBindVertexArray(0));
+    }
+
+    /* Without a vertex array, the attributes are enabled in the default
+     * state, where wlroots would see them */
+    for (GLuint location = 0; enabled_attributes; location++)
+    {
+        if (enabled_attributes & (1u << location))
+        {
+            GL_CALL(glDisableVertexAttribArray(location));
+            enabled_attributes &= ~(1u << location);
+        }
+    }
+
+    GL_CALL(glBindBuffer(target, 0));
+}
+
+void wf_gpu_buffer::set_attribute(GLuint location, int components,
+    size_t stride, size_t offset, GLuint divisor) const
+{
+    GL_CALL(glEnableVertexAttribArray(location));
+    GL_CALL(glVertexAttribPointer(location, components, GL_FLOAT, GL_FALSE,
+            stride, (void*)offset));
+
+    if (vao != (uint32_t)-1)
+    {
+        GL_CALL(glVertexAttribDivisor(location, divisor));
+    } else
+    {
+        if (location < 32)
+            enabled_attributes |= 1u << location;
+        static bool reported_divisor = false;
+        if (divisor && !reported_divisor)
+        {
+            log_error("instanced attributes need a GLES 3.0 context");
+            reported_divisor = true;
+        }
+    }
+}
+
+void wf_gpu_buffer::release()
+{
+    if (buffer != (uint32_t)-1)
+    {
+        GL_CALL(glDeleteBuffers(1, &buffer));
+    }
+
+    if (vao != (uint32_t)-1)
+    {
+        GL_CALL(glDeleteVertexArrays(1, &vao));
+    }
+
+    buffer = vao = -1;
+    capacity = used = 0;
+    enabled_attributes = 0;
+}
+
 wlr_box wf_framebuffer::framebuffer_box_from_damage_box(wlr_box box) const
 {
     if (has_nonstandard_transform)
@@ -407,6 +1635,19 @@ wlr_box wf_framebuffer::damage_box_from_geometry_box(wlr_box box) const
     return box;
 }
 
+wf_region wf_framebuffer::damage_region_from_geometry_region(
+    const wf_region& region) const
+{
+    if (scale == 1)
+        return region;
+
+    wf_region result;
+    for (const auto& rect : region)
+        result |= damage_box_from_geometry_box(wlr_box_from_pixman_box(rect));
+
+    return result;
+}
+
 wlr_box wf_framebuffer::framebuffer_box_from_geometry_box(wlr_box box) const
 {
     return framebuffer_box_from_damage_box(damage_box_from_geometry_box(box));
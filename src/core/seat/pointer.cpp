@@ -165,14 +165,14 @@ wf_pointf wf::LogicalPointer::get_absolute_position_from_relative(
     auto output_geometry = view->get_output_geometry();
     wf_point origin = {output_geometry.x, output_geometry.y};
 
-    for (auto& surf : view->enumerate_surfaces(origin))
+    view->for_each_surface([&] (const wf::surface_iterator_t& surf)
     {
         if (surf.surface == this->cursor_focus)
         {
             relative.x += surf.position.x;
             relative.y += surf.position.y;
         }
-    }
+    }, origin);
 
     relative = view->transform_point(relative);
     auto output = view->get_output()->get_layout_geometry();
@@ -74,6 +74,26 @@ void wf_drag_icon::damage_surface_box(const wlr_box& box)
     }
 }
 
+void wf_drag_icon::damage_surface_region(const wf_region& region)
+{
+    if (!is_mapped())
+        return;
+
+    auto damage = region + get_offset();
+    for (auto& output : wf::get_core().output_layout->get_outputs())
+    {
+        auto output_geometry = output->get_layout_geometry();
+        auto local = (damage & output_geometry) +
+            wf_point{-output_geometry.x, -output_geometry.y};
+
+        if (!local.empty())
+        {
+            const auto& fb = output->render->get_target_framebuffer();
+            output->render->damage(fb.damage_region_from_geometry_region(local));
+        }
+    }
+}
+
 void input_manager::validate_drag_request(wlr_seat_request_start_drag_event *ev)
 {
     auto seat = wf::get_core().get_current_seat();
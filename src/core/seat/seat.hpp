@@ -23,6 +23,7 @@ struct wf_drag_icon : public wf::wlr_child_surface_base_t
 
     void damage();
     void damage_surface_box(const wlr_box& rect) override;
+    void damage_surface_region(const wf_region& region) override;
 };
 
 class wf_input_device_internal : public wf::input_device_t
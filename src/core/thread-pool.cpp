@@ -0,0 +1,298 @@
+#include "thread-pool.hpp"
+#include "debug.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+extern "C"
+{
+#include <wayland-server.h>
+}
+
+namespace
+{
+/* The index of the worker running on the current thread, -1 if it isn't one */
+thread_local int current_worker = -1;
+}
+
+class wf::thread_pool_t::impl
+{
+    struct worker_t
+    {
+        std::mutex lock;
+        /* The worker takes tasks from the back, thieves from the front */
+        std::deque<task_t> tasks;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<worker_t>> workers;
+
+    /* Idle workers sleep until a task is queued */
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    /* Number of tasks in all queues, modified only with sleep_lock held */
+    int queued = 0;
+    bool stopping = false;
+
+    std::atomic<unsigned> next_worker{0};
+
+    /* Completion callbacks are handed to the main thread with an eventfd */
+    std::mutex completion_lock;
+    std::vector<task_t> completions;
+    int event_fd = -1;
+    wl_event_source *event_source = nullptr;
+
+    /* Core destroys the pool after the display and its event loop are gone,
+     * so the event source is removed when the loop is destroyed instead */
+    wl_listener on_loop_destroy;
+
+  public:
+    impl(wl_event_loop *loop, int count)
+    {
+        if (count <= 0)
+            count = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+
+        event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (event_fd < 0)
+        {
+            log_error("failed to create eventfd, thread pool completion "
+                "callbacks will not work");
+        } else
+        {
+            event_source = wl_event_loop_add_fd(loop, event_fd,
+                WL_EVENT_READABLE, handle_completions, this);
+
+            on_loop_destroy.notify = handle_loop_destroy;
+            wl_event_loop_add_destroy_listener(loop, &on_loop_destroy);
+        }
+
+        for (int i = 0; i < count; i++)
+            workers.push_back(std::make_unique<worker_t>());
+
+        for (int i = 0; i < count; i++)
+            workers[i]->thread = std::thread([=] () { worker_loop(i); });
+
+        log_info("started thread pool with %d workers", count);
+    }
+
+    ~impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_lock);
+            stopping = true;
+        }
+
+        wake.notify_all();
+        for (auto& worker : workers)
+            worker->thread.join();
+
+        if (event_source)
+        {
+            wl_list_remove(&on_loop_destroy.link);
+            wl_event_source_remove(event_source);
+        }
+
+        if (event_fd >= 0)
+            close(event_fd);
+    }
+
+    int get_worker_count() const
+    {
+        return workers.size();
+    }
+
+    void push(int idx, task_t task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(workers[idx]->lock);
+            workers[idx]->tasks.push_back(std::move(task));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(sleep_lock);
+            ++queued;
+        }
+
+        wake.notify_one();
+    }
+
+    /* Take a task from the worker's own queue, or steal one from the others */
+    bool take(int idx, task_t& task)
+    {
+        int count = workers.size();
+        for (int i = 0; i < count; i++)
+        {
+            auto& worker = workers[(idx + i) % count];
+            std::lock_guard<std::mutex> lock(worker->lock);
+            if (worker->tasks.empty())
+                continue;
+
+            if (i == 0)
+            {
+                task = std::move(worker->tasks.back());
+                worker->tasks.pop_back();
+            } else
+            {
+                task = std::move(worker->tasks.front());
+                worker->tasks.pop_front();
+            }
+
+            std::lock_guard<std::mutex> sleep(sleep_lock);
+            --queued;
+            return true;
+        }
+
+        return false;
+    }
+
+    void worker_loop(int idx)
+    {
+        current_worker = idx;
+        while (true)
+        {
+            task_t task;
+            if (take(idx, task))
+            {
+                task();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleep_lock);
+            wake.wait(lock, [=] () { return stopping || queued > 0; });
+            if (stopping)
+                return;
+        }
+    }
+
+    int choose_worker(int affinity)
+    {
+        if (affinity >= 0)
+            return affinity % workers.size();
+
+        /* Keep tasks spawned by a task on the same worker */
+        if (current_worker >= 0)
+            return current_worker;
+
+        return next_worker++ % workers.size();
+    }
+
+    void post_completion(task_t on_complete)
+    {
+        {
+            std::lock_guard<std::mutex> lock(completion_lock);
+            completions.push_back(std::move(on_complete));
+        }
+
+        uint64_t value = 1;
+        if (write(event_fd, &value, sizeof(value)) < 0)
+            log_error("failed to signal thread pool completion");
+    }
+
+    static void handle_loop_destroy(wl_listener *listener, void*)
+    {
+        impl *self = wl_container_of(listener, self, on_loop_destroy);
+        wl_list_remove(&self->on_loop_destroy.link);
+        wl_event_source_remove(self->event_source);
+        self->event_source = nullptr;
+    }
+
+    static int handle_completions(int fd, uint32_t mask, void *data)
+    {
+        auto self = static_cast<impl*> (data);
+
+        uint64_t value;
+        if (read(fd, &value, sizeof(value)) < 0)
+            return 0;
+
+        std::vector<task_t> ready;
+        {
+            std::lock_guard<std::mutex> lock(self->completion_lock);
+            std::swap(ready, self->completions);
+        }
+
+        for (auto& callback : ready)
+            callback();
+
+        return 0;
+    }
+
+    void submit(task_t task, task_t on_complete, int affinity)
+    {
+        if (on_complete && event_source)
+        {
+            auto run = [=] ()
+            {
+                task();
+                post_completion(on_complete);
+            };
+
+            push(choose_worker(affinity), run);
+        } else
+        {
+            push(choose_worker(affinity), std::move(task));
+        }
+    }
+
+    void parallel_for(int begin, int end, int grain, const range_task_t& task)
+    {
+        if (begin >= end)
+            return;
+
+        grain = std::max(grain, 1);
+        int chunks = (end - begin + grain - 1) / grain;
+        if (chunks == 1)
+        {
+            task(begin, end);
+            return;
+        }
+
+        struct job_t
+        {
+            std::atomic<int> next{0}, done{0};
+            std::mutex lock;
+            std::condition_variable finished;
+        };
+
+        /* Helpers which start after all chunks have been taken only touch
+         * the job, so it must outlive this call */
+        auto job = std::make_shared<job_t>();
+        auto run_chunks = [job, begin, end, grain, chunks, &task] ()
+        {
+            int i;
+            while ((i = job->next++) < chunks)
+            {
+                task(begin + i * grain, std::min(end, begin + (i + 1) * grain));
+                if (++job->done == chunks)
+                {
+                    std::lock_guard<std::mutex> lock(job->lock);
+                    job->finished.notify_all();
+                }
+            }
+        };
+
+        int helpers = std::min(chunks - 1, get_worker_count());
+        for (int i = 0; i < helpers; i++)
+            push(choose_worker(ANY_WORKER), run_chunks);
+
+        run_chunks();
+
+        std::unique_lock<std::mutex> lock(job->lock);
+        job->finished.wait(lock, [&] () { return job->done == chunks; });
+    }
+};
+
+wf::thread_pool_t::thread_pool_t(wl_event_loop *loop, int workers)
+    : pimpl(new impl(loop, workers)) { }
+wf::thread_pool_t::~thread_pool_t() = default;
+int wf::thread_pool_t::get_worker_count() const { return pimpl->get_worker_count(); }
+void wf::thread_pool_t::submit(task_t task, task_t on_complete, int affinity) { pimpl->submit(task, on_complete, affinity); }
+void wf::thread_pool_t::parallel_for(int begin, int end, int grain,
+    const range_task_t& task) { pimpl->parallel_for(begin, end, grain, task); }
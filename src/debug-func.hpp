@@ -1,6 +1,8 @@
 #include <signal.h>
 #include <execinfo.h>
 #include <cxxabi.h>
+#include <cstdlib>
+#include <new>
 #include <iostream>
 
 extern "C"
@@ -84,4 +86,49 @@ const char *wf_strip_path(const char *filepath)
         }
     }
     return filepath;
-}                                                                                                                                               
+}                                                                                                                                               
+
+#ifdef WAYFIRE_DEBUG_ENABLED
+/* Count the allocations of each thread, so that the render manager can check
+ * that repainting doesn't allocate. The default operator delete frees memory
+ * with free(), so only operator new has to be replaced. */
+static thread_local uint64_t allocation_count = 0;
+
+void *operator new(std::size_t size)
+{
+    ++allocation_count;
+    if (void *ptr = std::malloc(size ? size : 1))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+uint64_t wf_get_allocation_count()
+{
+    return allocation_count;
+}
+
+static thread_local uint64_t cache_growth_count = 0;
+
+void wf_note_cache_growth()
+{
+    ++cache_growth_count;
+}
+
+uint64_t wf_get_cache_growth_count()
+{
+    return cache_growth_count;
+}
+#else
+uint64_t wf_get_allocation_count()
+{
+    return 0;
+}
+
+void wf_note_cache_growth() { }
+
+uint64_t wf_get_cache_growth_count()
+{
+    return 0;
+}
+#endif
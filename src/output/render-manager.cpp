@@ -9,7 +9,8 @@
 #include "debug.hpp"
 #include "../main.hpp"
 #include <algorithm>
-#include <nonstd/reverse.hpp>
+#include <cmath>
+#include <cstdlib>
 #include <nonstd/safe-list.hpp>
 
 extern "C"
@@ -272,6 +273,16 @@ struct postprocessing_manager_t
     {
         post_effects.remove_all(hook);
         output->render->damage_whole_idle();
+
+        /* Return the buffers to the framebuffer pool, so that they can be
+         * reused while postprocessing is not active */
+        if (post_effects.size() == 0)
+        {
+            OpenGL::render_begin();
+            for (auto& buffer : post_buffers)
+                buffer.release();
+            OpenGL::render_end();
+        }
     }
 
     /* Run all postprocessing effects, rendering to alternating buffers and
@@ -325,6 +336,89 @@ struct postprocessing_manager_t
     }
 };
 
+/**
+ * Records timing and damage statistics of the repainted frames in a ring
+ * buffer of fixed size.
+ */
+struct frame_statistics_manager_t
+{
+    static constexpr size_t history_size = 128;
+    std::vector<frame_statistics_t> history;
+    /* Index in history where the next frame will be stored */
+    size_t next_frame = 0;
+
+    /* The statistics of the frame which is currently being repainted */
+    frame_statistics_t current;
+    timespec phase_started;
+
+    static int64_t get_elapsed_usec(const timespec& from, const timespec& to)
+    {
+        return (to.tv_sec - from.tv_sec) * 1000000ll +
+            (to.tv_nsec - from.tv_nsec) / 1000ll;
+    }
+
+    /** Reset the current statistics and start measuring the first phase */
+    void start_frame()
+    {
+        current = frame_statistics_t{};
+        clock_gettime(CLOCK_MONOTONIC, &current.repaint_started);
+        /* Drop the state changes made outside of the repaint */
+        OpenGL::reset_state_statistics();
+        phase_started = current.repaint_started;
+    }
+
+    /** Record the time since the last phase ended as time spent in phase */
+    void end_phase(frame_phase_t phase)
+    {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        current.phase_usec[phase] += get_elapsed_usec(phase_started, now);
+        phase_started = now;
+    }
+
+    /** Store the current frame in the history.
+     *
+     * @param swap_damage The damage which was repainted, in output pixels */
+    void finish_frame(const wf_region& swap_damage)
+    {
+        current.total_usec =
+            get_elapsed_usec(current.repaint_started, phase_started);
+
+        auto gl_stats = OpenGL::reset_state_statistics();
+        current.gl_state_changes = gl_stats.state_changes;
+        current.gl_redundant_state_changes = gl_stats.redundant_state_changes;
+
+        for (const auto& rect : swap_damage)
+        {
+            current.damaged_pixels +=
+                uint64_t(rect.x2 - rect.x1) * (rect.y2 - rect.y1);
+        }
+
+        if (history.size() < history_size) {
+            history.push_back(current);
+        } else {
+            history[next_frame] = current;
+        }
+
+        next_frame = (next_frame + 1) % history_size;
+    }
+
+    /** @return The recorded frames, from the oldest to the newest */
+    std::vector<frame_statistics_t> get_history() const
+    {
+        if (history.size() < history_size)
+            return history;
+
+        std::vector<frame_statistics_t> result;
+        result.reserve(history_size);
+        result.insert(result.end(), history.begin() + next_frame, history.end());
+        result.insert(result.end(), history.begin(), history.begin() + next_frame);
+
+        return result;
+    }
+};
+
 class wf::render_manager::impl
 {
   public:
@@ -334,9 +428,14 @@ class wf::render_manager::impl
     std::unique_ptr<output_damage_t> output_damage;
     std::unique_ptr<effect_hook_manager_t> effects;
     std::unique_ptr<postprocessing_manager_t> postprocessing;
+    std::unique_ptr<frame_statistics_manager_t> frame_stats;
 
     wf_option background_color_opt;
     wf_option_callback background_color_opt_changed;
+    /* Minimal interval between frame callbacks for occluded views, in ms */
+    wf_option occluded_frame_interval_opt;
+    /* Abort when a steady-state repaint allocates, for benchmarks */
+    wf_option abort_on_repaint_allocations_opt;
     /* The default color which is user configurable */
     wf_color default_color = {0.0f, 0.0f, 0.0f, 1.0f};
 
@@ -348,6 +447,7 @@ class wf::render_manager::impl
 
         effects = std::make_unique<effect_hook_manager_t> ();
         postprocessing = std::make_unique<postprocessing_manager_t>(o);
+        frame_stats = std::make_unique<frame_statistics_manager_t>();
 
         on_frame.set_callback([&] (void*) { paint(); });
         on_frame.connect(&output_damage->damage_manager->events.frame);
@@ -364,6 +464,10 @@ class wf::render_manager::impl
         background_color_opt = section->get_option("background_color", "0 0 0 1");
         background_color_opt->add_updated_handler(&background_color_opt_changed);
         background_color_opt_changed();
+        occluded_frame_interval_opt =
+            section->get_option("occluded_frame_interval", "1000");
+        abort_on_repaint_allocations_opt =
+            section->get_option("abort_on_repaint_allocations", "0");
 
         output_damage->schedule_repaint();
     }
@@ -522,11 +626,12 @@ class wf::render_manager::impl
     void paint()
     {
         /* Part 1: frame setup: query damage, etc. */
-        timespec repaint_started;
-        clock_gettime(CLOCK_MONOTONIC, &repaint_started);
+        frame_stats->start_frame();
+        occlusion_cache.valid = false;
         wf_region swap_damage;
 
         effects->run_effects(OUTPUT_EFFECT_PRE);
+        frame_stats->end_phase(FRAME_PHASE_PRE_EFFECTS);
 
         bool needs_swap;
         if (!output_damage->make_current(needs_swap))
@@ -545,9 +650,11 @@ class wf::render_manager::impl
 
         /* Part 2: call the renderer, which draws the scenegraph */
         render_output(swap_damage);
+        frame_stats->end_phase(FRAME_PHASE_RENDER_OUTPUT);
 
         /* Part 3: finalize the scene: overlay effects and sw cursors */
         effects->run_effects(OUTPUT_EFFECT_OVERLAY);
+        frame_stats->end_phase(FRAME_PHASE_OVERLAY_EFFECTS);
 
         if (postprocessing->post_effects.size())
             swap_damage |= output_damage->get_damage_box();
@@ -555,6 +662,7 @@ class wf::render_manager::impl
         OpenGL::render_begin(get_target_framebuffer());
         wlr_output_render_software_cursors(output->handle, swap_damage.to_pixman());
         OpenGL::render_end();
+        frame_stats->end_phase(FRAME_PHASE_SOFTWARE_CURSORS);
 
         /* Part 4: postprocessing effects */
         postprocessing->run_post_effects();
@@ -564,13 +672,33 @@ class wf::render_manager::impl
             OpenGL::clear({0, 0, 0, 1});
             OpenGL::render_end();
         }
+        frame_stats->end_phase(FRAME_PHASE_POST_EFFECTS);
 
         /* Part 5: finalize frame: swap buffers, send frame_done, etc */
         OpenGL::unbind_output(output);
+
+        /* swap_buffers() transforms the damage to buffer coordinates, so
+         * we need to record the damaged area before that */
+        wf_region repainted_damage = swap_damage;
         output_damage->swap_buffers(swap_damage);
+        frame_stats->end_phase(FRAME_PHASE_SWAP_BUFFERS);
+        emit_frame_stats(repainted_damage);
+
         post_paint();
     }
 
+    /**
+     * Store the statistics of the current frame and notify plugins about them
+     */
+    void emit_frame_stats(const wf_region& repainted_damage)
+    {
+        frame_stats->finish_frame(repainted_damage);
+
+        frame_stats_signal data;
+        data.stats = &frame_stats->current;
+        output->render->emit_signal(wf::signals::frame_stats, &data);
+    }
+
     /**
      * Execute post-paint actions.
      */
@@ -581,38 +709,213 @@ class wf::render_manager::impl
         if (constant_redraw_counter)
             output_damage->schedule_repaint();
 
-        /* TODO: do this only if the view isn't fully occluded by another */
-        std::vector<wayfire_view> visible_views;
+        auto& visible_views = frame_done_views;
+        auto& occluded = frame_done_occluded;
         if (renderer)
         {
+            /* Plugins with custom renderers may show the views in arbitrary
+             * ways, so we cannot know which ones are hidden */
             visible_views = output->workspace->get_views_in_layer(
                 wf::VISIBLE_LAYERS);
+            occluded.assign(visible_views.size(), false);
         } else
         {
-            visible_views = output->workspace->get_views_on_workspace(
-                output->workspace->get_current_workspace(),
-                wf::MIDDLE_LAYERS, false);
+            auto cws = output->workspace->get_current_workspace();
+            visible_views.clear();
+            output->workspace->for_each_view_on_workspace(cws,
+                wf::VISIBLE_LAYERS, false,
+                [&] (wayfire_view view) { visible_views.push_back(view); });
+            occluded = get_occlusion(cws, visible_views);
 
             // send to all panels/backgrounds/etc
             auto additional_views = output->workspace->get_views_in_layer(
                 wf::BELOW_LAYERS | wf::ABOVE_LAYERS);
-
-            visible_views.insert(visible_views.end(),
-                additional_views.begin(), additional_views.end());
+            for (auto& view : additional_views)
+            {
+                auto it = std::find(visible_views.begin(),
+                    visible_views.end(), view);
+
+                if (it == visible_views.end())
+                {
+                    visible_views.push_back(view);
+                    occluded.push_back(false);
+                }
+            }
         }
 
+        bool has_throttled_views = false;
         timespec repaint_ended;
         clock_gettime(CLOCK_MONOTONIC, &repaint_ended);
-        for (auto& view : visible_views)
+        for (size_t i = 0; i < visible_views.size(); i++)
         {
+            auto& view = visible_views[i];
             if (!view->is_mapped())
                 continue;
 
-            for (auto& child : view->enumerate_surfaces())
+            if (occluded[i] && !should_send_occluded_frame(view, repaint_ended))
+            {
+                has_throttled_views = true;
+                continue;
+            }
+
+            view->for_each_surface([&] (const wf::surface_iterator_t& child)
+            {
                 child.surface->send_frame_done(repaint_ended);
+            });
+        }
+
+        if (has_throttled_views)
+            schedule_occluded_frame();
+
+        occlusion_cache.valid = false;
+        visible_views.clear();
+    }
+
+    /* The views which get frame callbacks in post_paint(), and whether they
+     * are occluded, kept between frames so that their memory can be reused */
+    std::vector<wayfire_view> frame_done_views;
+    std::vector<bool> frame_done_occluded;
+
+    /**
+     * Remembers when the last frame callback was sent to an occluded view
+     */
+    struct occluded_view_data_t : public wf::custom_data_t
+    {
+        timespec last_frame_done = {0, 0};
+    };
+
+    /**
+     * Check whether an occluded view should get a frame callback. Occluded
+     * views get frame callbacks only once per occluded_frame_interval, so
+     * that hidden clients do not redraw content nobody sees.
+     */
+    bool should_send_occluded_frame(wayfire_view view, const timespec& now)
+    {
+        int interval = occluded_frame_interval_opt->as_cached_int();
+        if (interval <= 0)
+            return true;
+
+        auto data = view->get_slot_data_safe<occluded_view_data_t>();
+        int64_t elapsed_ms =
+            (now.tv_sec - data->last_frame_done.tv_sec) * 1000 +
+            (now.tv_nsec - data->last_frame_done.tv_nsec) / 1000000;
+
+        if (elapsed_ms < interval)
+            return false;
+
+        data->last_frame_done = now;
+        return true;
+    }
+
+    /**
+     * Make sure there is a frame after occluded_frame_interval, even if the
+     * output isn't damaged, so that throttled views get their frame callback.
+     * Each call postpones the timer, but as long as the output is repainted,
+     * post_paint() takes care of the throttled views anyway.
+     */
+    wf::wl_timer occluded_frame_timer;
+    void schedule_occluded_frame()
+    {
+        occluded_frame_timer.set_timeout(
+            occluded_frame_interval_opt->as_cached_int(), [=] ()
+        {
+            output_damage->schedule_repaint();
+        });
+    }
+
+    /**
+     * Calculate which of the given views are completely hidden behind the
+     * opaque regions of the views above them.
+     *
+     * @param views The views on a workspace, ordered from the topmost one.
+     * @param ws_delta The offset of the workspace relative to the current
+     *        workspace, in output-local coordinates.
+     * @param occluded Set to whether each view is fully occluded.
+     */
+    void calculate_occlusion(const std::vector<wayfire_view>& views,
+        wf_point ws_delta, std::vector<bool>& occluded)
+    {
+        occluded.assign(views.size(), false);
+
+        auto fb = get_target_framebuffer();
+        wf_region uncovered{output_damage->get_damage_box()};
+        for (size_t i = 0; i < views.size(); i++)
+        {
+            auto& view = views[i];
+            if (!view->is_visible())
+                continue;
+
+            wf_point view_delta{0, 0};
+            if (view->role != VIEW_ROLE_SHELL_VIEW)
+                view_delta = ws_delta;
+
+            auto bbox = view->get_bounding_box() + (-view_delta);
+            bbox = fb.damage_box_from_geometry_box(bbox);
+            if ((uncovered & bbox).empty())
+            {
+                occluded[i] = true;
+                continue;
+            }
+
+            /* Transformed views may be translucent or may not cover their
+             * opaque region anymore, and snapshotted views have no opaque
+             * region at all */
+            if (view->has_transformer() || !view->is_mapped())
+                continue;
+
+            auto obox = view->get_output_geometry();
+            obox.x -= view_delta.x;
+            obox.y -= view_delta.y;
+            view->for_each_surface([&] (const wf::surface_iterator_t& child)
+            {
+                child.surface->subtract_opaque(uncovered,
+                    child.position.x, child.position.y);
+            }, {obox.x, obox.y});
         }
     }
 
+    /**
+     * The occlusion of the views on the current workspace, as calculated
+     * while repainting the current frame. Reused when sending frame
+     * callbacks, so that the occlusion is calculated once per frame.
+     */
+    struct
+    {
+        bool valid = false;
+        std::vector<wayfire_view> views;
+        std::vector<bool> occluded;
+    } occlusion_cache;
+
+    /* The occlusion of views on other workspaces than the current one */
+    std::vector<bool> occlusion_scratch;
+
+    /**
+     * Same as calculate_occlusion(), but reuses the cached occlusion if it
+     * was already calculated for the current workspace in this frame.
+     *
+     * The result is valid until the next call.
+     */
+    const std::vector<bool>& get_occlusion(wf_point ws,
+        const std::vector<wayfire_view>& views)
+    {
+        auto cws = output->workspace->get_current_workspace();
+        if (occlusion_cache.valid && ws == cws && occlusion_cache.views == views)
+            return occlusion_cache.occluded;
+
+        auto g = output->get_relative_geometry();
+        wf_point ws_delta = {(ws.x - cws.x) * g.width, (ws.y - cws.y) * g.height};
+        if (ws != cws)
+        {
+            calculate_occlusion(views, ws_delta, occlusion_scratch);
+            return occlusion_scratch;
+        }
+
+        calculate_occlusion(views, ws_delta, occlusion_cache.occluded);
+        occlusion_cache.valid = true;
+        occlusion_cache.views = views;
+        return occlusion_cache.occluded;
+    }
+
     /* Workspace stream implementation */
     void workspace_stream_start(workspace_stream_t& stream)
     {
@@ -639,7 +942,43 @@ class wf::render_manager::impl
         wf_point pos;
         wf_region damage;
     };
-    using damaged_surface = std::unique_ptr<damaged_surface_t>;
+
+    /**
+     * Holds the damaged surfaces of the workspace streams being repainted.
+     *
+     * The surfaces of a stream are allocated one after the other, and released
+     * together after the stream has been rendered, so the arena works like a
+     * stack, even if a plugin updates another stream in between. Released
+     * surfaces are reused in the next frames, so once the arena is big enough,
+     * scheduling surfaces doesn't allocate. Their damage is always assigned
+     * when they are scheduled, and wf_region reuses its storage.
+     */
+    struct damaged_surface_arena_t
+    {
+        std::vector<std::unique_ptr<damaged_surface_t>> surfaces;
+        /* Number of surfaces in use, from the start of surfaces */
+        size_t used = 0;
+
+        damaged_surface_t *allocate()
+        {
+            if (used == surfaces.size())
+                surfaces.push_back(std::make_unique<damaged_surface_t>());
+
+            auto ds = surfaces[used++].get();
+            ds->surface = nullptr;
+            ds->view = nullptr;
+            ds->pos = {0, 0};
+
+            return ds;
+        }
+
+        /** Release all surfaces allocated after the given number of surfaces
+         * was in use */
+        void release(size_t mark)
+        {
+            used = mark;
+        }
+    } damaged_surfaces;
 
     /**
      * Represents the state while calculating what parts of the output
@@ -647,7 +986,10 @@ class wf::render_manager::impl
      */
     struct workspace_stream_repaint_t
     {
-        std::vector<damaged_surface> to_render;
+        /* The surfaces to render are damaged_surfaces.surfaces in
+         * [first_surface, last_surface), from the topmost one */
+        size_t first_surface = 0;
+        size_t last_surface = 0;
         wf_region ws_damage;
         wf_framebuffer fb;
 
@@ -665,7 +1007,7 @@ class wf::render_manager::impl
     void schedule_snapshotted_view(workspace_stream_repaint_t& repaint,
         wayfire_view view, wf_point view_delta)
     {
-        auto ds = damaged_surface(new damaged_surface_t);
+        auto ds = damaged_surfaces.allocate();
 
         auto bbox = view->get_bounding_box() + (-view_delta);
         bbox = repaint.fb.damage_box_from_geometry_box(bbox);
@@ -676,7 +1018,12 @@ class wf::render_manager::impl
             ds->pos = view_delta;
             ds->view = view.get();
 
-            repaint.to_render.push_back(std::move(ds));
+            repaint.last_surface = damaged_surfaces.used;
+            ++frame_stats->current.surfaces_scheduled;
+        } else
+        {
+            damaged_surfaces.release(repaint.last_surface);
+            ++frame_stats->current.surfaces_culled;
         }
     }
 
@@ -691,9 +1038,12 @@ class wf::render_manager::impl
             return;
 
         if (repaint.ws_damage.empty())
+        {
+            ++frame_stats->current.surfaces_culled;
             return;
+        }
 
-        auto ds = damaged_surface(new damaged_surface_t);
+        auto ds = damaged_surfaces.allocate();
 
         wlr_box obox = {
             .x = pos.x,
@@ -711,9 +1061,44 @@ class wf::render_manager::impl
 
             /* Subtract opaque region from workspace damage. The views below
              * won't be visible, so no need to damage them */
-            ds->surface->subtract_opaque(repaint.ws_damage, pos.x, pos.y);
-            repaint.to_render.push_back(std::move(ds));
+            subtract_opaque(repaint, ds->surface, pos);
+            repaint.last_surface = damaged_surfaces.used;
+            ++frame_stats->current.surfaces_scheduled;
+        } else
+        {
+            damaged_surfaces.release(repaint.last_surface);
+            ++frame_stats->current.surfaces_culled;
+        }
+    }
+
+    /**
+     * Subtract the opaque region of a surface from the damage of the stream.
+     * Surfaces calculate their opaque region with the output scale, so for
+     * scaled streams it has to be converted to the scale of the stream.
+     */
+    void subtract_opaque(workspace_stream_repaint_t& repaint,
+        wf::surface_interface_t *surface, wf_point pos)
+    {
+        float stream_scale = repaint.fb.scale / output->handle->scale;
+        if (stream_scale == 1.0f)
+        {
+            surface->subtract_opaque(repaint.ws_damage, pos.x, pos.y);
+            return;
         }
+
+        wf_region opaque{wlr_box{pos.x, pos.y,
+            surface->get_size().width, surface->get_size().height}};
+        opaque *= output->handle->scale;
+
+        wf_region translucent = opaque;
+        surface->subtract_opaque(translucent, pos.x, pos.y);
+        opaque ^= translucent;
+
+        /* Scaling rounds the region outwards, but only the pixels which are
+         * fully opaque may be subtracted */
+        opaque *= stream_scale;
+        opaque.expand_edges(-1);
+        repaint.ws_damage ^= opaque;
     }
 
     /**
@@ -733,8 +1118,10 @@ class wf::render_manager::impl
         offset.x -= og.x;
         offset.y -= og.y;
 
-        for (auto& child : drag_icon->enumerate_surfaces(offset))
+        drag_icon->for_each_surface([&] (const wf::surface_iterator_t& child)
+        {
             schedule_surface(repaint, child.surface, child.position);
+        }, offset);
     }
 
     /**
@@ -747,6 +1134,10 @@ class wf::render_manager::impl
             drag_icon->set_output(nullptr);
     }
 
+    /* The views on the workspace of the stream being repainted, kept
+     * between frames so that its memory can be reused */
+    std::vector<wayfire_view> stream_views;
+
     /**
      * Iterate all visible surfaces on the workspace, and check whether
      * they need repaint.
@@ -754,20 +1145,31 @@ class wf::render_manager::impl
     void check_schedule_surfaces(workspace_stream_repaint_t& repaint,
         workspace_stream_t& stream)
     {
-        auto views = output->workspace->get_views_on_workspace(stream.ws,
-            wf::VISIBLE_LAYERS, false);
+        auto& views = stream_views;
+        views.clear();
+        output->workspace->for_each_view_on_workspace(stream.ws,
+            wf::VISIBLE_LAYERS, false,
+            [&] (wayfire_view view) { views.push_back(view); });
 
         schedule_drag_icon(repaint);
 
-        auto it = views.begin();
-        while (it != views.end() && !repaint.ws_damage.empty())
+        /* Views fully covered by opaque views above them won't be visible
+         * regardless of damage, so we don't even need to look at their
+         * surfaces */
+        const auto& occluded = get_occlusion(stream.ws, views);
+
+        size_t i = 0;
+        for (; i < views.size() && !repaint.ws_damage.empty(); i++)
         {
-            auto view = *it;
+            auto view = views[i];
             wf_point view_delta{0, 0};
 
             if (!view->is_visible())
+                continue;
+
+            if (occluded[i])
             {
-                ++it;
+                ++frame_stats->current.surfaces_culled;
                 continue;
             }
 
@@ -792,14 +1194,35 @@ class wf::render_manager::impl
                 obox.x -= view_delta.x;
                 obox.y -= view_delta.y;
 
-                for (auto& child : view->enumerate_surfaces({obox.x, obox.y}))
+                view->for_each_surface([&] (const wf::surface_iterator_t& child)
+                {
                     schedule_surface(repaint, child.surface, child.position);
+                }, {obox.x, obox.y});
             }
+        }
 
-            ++it;
+        /* The opaque regions of the views above cover all of the damage, so
+         * the remaining views don't need to be repainted */
+        for (; i < views.size(); i++)
+        {
+            if (views[i]->is_visible())
+                ++frame_stats->current.surfaces_culled;
         }
     }
 
+    /**
+     * Streams are rendered with the same scale in both directions, so that
+     * surfaces, views and damage can be scaled like in the output framebuffer.
+     * The scale is rounded up to a multiple of 1/8, so that plugins which
+     * animate the scale do not reallocate the stream buffer on each frame.
+     */
+    static float get_stream_scale(float scale_x, float scale_y)
+    {
+        const float steps = 8;
+        float scale = std::ceil(std::max(scale_x, scale_y) * steps) / steps;
+        return std::max(1.0f / steps, std::min(scale, 1.0f));
+    }
+
     /**
      * Setup the stream, calculate damaged region, etc.
      */
@@ -807,23 +1230,28 @@ class wf::render_manager::impl
         workspace_stream_t& stream, float scale_x, float scale_y)
     {
         workspace_stream_repaint_t repaint;
+        repaint.first_surface = repaint.last_surface = damaged_surfaces.used;
         repaint.ws_damage = output_damage->get_ws_damage(stream.ws);
 
-        /* we don't have to update anything */
-        if (repaint.ws_damage.empty())
-            return repaint;
+        /* Streams which render directly to the output cannot be scaled */
+        float scale = 1;
+        if (stream.buffer.fb != 0)
+            scale = get_stream_scale(scale_x, scale_y);
 
-        if (scale_x != stream.scale_x || scale_y != stream.scale_y)
+        /* The contents of the buffer are invalid at the new scale */
+        if (scale != stream.scale_x || scale != stream.scale_y)
         {
-            /* FIXME: enable scaled rendering */
-            //        stream->scale_x = scale_x;
-            //        stream->scale_y = scale_y;
-
-            //   ws_damage |= get_damage_box();
+            stream.scale_x = stream.scale_y = scale;
+            repaint.ws_damage |= output_damage->get_damage_box();
         }
 
+        /* we don't have to update anything */
+        if (repaint.ws_damage.empty())
+            return repaint;
+
         OpenGL::render_begin();
-        stream.buffer.allocate(output->handle->width, output->handle->height);
+        stream.buffer.allocate(std::ceil(output->handle->width * scale),
+            std::ceil(output->handle->height * scale));
         OpenGL::render_end();
 
         repaint.fb = get_target_framebuffer();
@@ -832,6 +1260,13 @@ class wf::render_manager::impl
             /* Use the workspace buffers */
             repaint.fb.fb = stream.buffer.fb;
             repaint.fb.tex = stream.buffer.tex;
+            repaint.fb.viewport_width = stream.buffer.viewport_width;
+            repaint.fb.viewport_height = stream.buffer.viewport_height;
+            repaint.fb.scale *= scale;
+
+            /* Damage is tracked in output buffer coordinates */
+            if (scale != 1)
+                repaint.ws_damage *= scale;
         }
 
         auto g = output->get_relative_geometry();
@@ -861,8 +1296,11 @@ class wf::render_manager::impl
     {
         wf_geometry fb_geometry = repaint.fb.geometry;
 
-        for (auto& ds : wf::reverse(repaint.to_render))
+        /* Surfaces are drawn from the bottom up. Rendering can update other
+         * streams, which may grow the arena, so index it on each iteration */
+        for (size_t i = repaint.last_surface; i > repaint.first_surface; i--)
         {
+            auto ds = damaged_surfaces.surfaces[i - 1].get();
             if (ds->view)
             {
                 repaint.fb.geometry.x = ds->pos.x;
@@ -878,35 +1316,142 @@ class wf::render_manager::impl
         }
     }
 
+    /**
+     * The storage of the containers which are reused by each repaint. If it
+     * doesn't change while a stream is scheduled, the repaint is in a steady
+     * state and must not allocate.
+     */
+    struct repaint_storage_t
+    {
+        size_t arena_surfaces, arena_capacity;
+        size_t stream_views, cached_views, cached_occlusion, occlusion_scratch;
+        int buffer_width, buffer_height;
+        uint64_t cache_growths;
+
+        bool operator == (const repaint_storage_t& other) const
+        {
+            return arena_surfaces == other.arena_surfaces &&
+                arena_capacity == other.arena_capacity &&
+                stream_views == other.stream_views &&
+                cached_views == other.cached_views &&
+                cached_occlusion == other.cached_occlusion &&
+                occlusion_scratch == other.occlusion_scratch &&
+                buffer_width == other.buffer_width &&
+                buffer_height == other.buffer_height &&
+                cache_growths == other.cache_growths;
+        }
+    };
+
+    repaint_storage_t get_repaint_storage(const workspace_stream_t& stream)
+    {
+        return {
+            damaged_surfaces.surfaces.size(),
+            damaged_surfaces.surfaces.capacity(),
+            stream_views.capacity(),
+            occlusion_cache.views.capacity(),
+            occlusion_cache.occluded.capacity(),
+            occlusion_scratch.capacity(),
+            stream.buffer.viewport_width,
+            stream.buffer.viewport_height,
+            wf_get_cache_growth_count(),
+        };
+    }
+
+    /* Steady-state repaints which allocated are reported at most once in
+     * this interval, in ms */
+    static constexpr uint32_t allocation_report_interval = 10000;
+    uint32_t last_allocation_report = 0;
+    /* Steady-state repaints which allocated since the last report */
+    uint32_t unreported_allocating_repaints = 0;
+
+    /**
+     * Record the heap allocations made while scheduling a stream, and report
+     * steady-state repaints which allocated. Allocations are counted only in
+     * debug builds, so the check does nothing otherwise.
+     *
+     * The counted code includes callbacks of views, surfaces and transformers,
+     * some of which are implemented by plugins, for ex. get_bounding_box() of
+     * the animate plugin's transformers. Their allocations are counted too,
+     * so an error here doesn't always mean core allocated. Benchmarks, which
+     * run without such plugins, can abort instead with the
+     * core/abort_on_repaint_allocations option.
+     */
+    void check_repaint_allocations(uint64_t allocations,
+        const repaint_storage_t& before, const workspace_stream_t& stream)
+    {
+        frame_stats->current.repaint_allocations += allocations;
+        if (allocations == 0 || !(before == get_repaint_storage(stream)))
+            return;
+
+        if (abort_on_repaint_allocations_opt->as_cached_int())
+        {
+            log_error("steady-state repaint of output %s allocated %lu times",
+                output->handle->name, (unsigned long)allocations);
+            wf_print_trace();
+            std::abort();
+        }
+
+        ++unreported_allocating_repaints;
+        uint32_t now = get_current_time();
+        if (last_allocation_report != 0 &&
+            now - last_allocation_report < allocation_report_interval)
+        {
+            return;
+        }
+
+        log_error("steady-state repaint of output %s allocated %lu times "
+            "(%u allocating repaints since the last report)",
+            output->handle->name, (unsigned long)allocations,
+            unreported_allocating_repaints);
+        last_allocation_report = now ?: 1;
+        unreported_allocating_repaints = 0;
+    }
+
     void workspace_stream_update(workspace_stream_t& stream,
         float scale_x = 1, float scale_y = 1)
     {
+        repaint_storage_t storage = get_repaint_storage(stream);
+        uint64_t started = wf_get_allocation_count();
         workspace_stream_repaint_t repaint =
             calculate_repaint_for_stream(stream, scale_x, scale_y);
+        uint64_t allocations = wf_get_allocation_count() - started;
 
         if (repaint.ws_damage.empty())
+        {
+            check_repaint_allocations(allocations, storage, stream);
             return;
+        }
 
         {
             stream_signal_t data(repaint.ws_damage, repaint.fb);
-            output->render->emit_signal("workspace-stream-pre", &data);
+            output->render->emit_signal(wf::signals::workspace_stream_pre, &data);
         }
 
+        /* Plugins may allocate in the signal handlers, so they aren't counted */
+        started = wf_get_allocation_count();
         check_schedule_surfaces(repaint, stream);
+        allocations += wf_get_allocation_count() - started;
+        check_repaint_allocations(allocations, storage, stream);
 
-        if (stream.background.a < 0)
         {
-            clear_empty_areas(repaint, default_color);
-        } else {
-            clear_empty_areas(repaint, stream.background);
-        }
+            /* Surfaces and transformers render to the stream with nested
+             * render_begin() calls, so the renderer is begun only once */
+            OpenGL::render_pass_t pass{repaint.fb};
+            if (stream.background.a < 0)
+            {
+                clear_empty_areas(repaint, default_color);
+            } else {
+                clear_empty_areas(repaint, stream.background);
+            }
 
-        render_views(repaint);
+            render_views(repaint);
+        }
 
+        damaged_surfaces.release(repaint.first_surface);
         unschedule_drag_icon();
         {
             stream_signal_t data(repaint.ws_damage, repaint.fb);
-            output->render->emit_signal("workspace-stream-post", &data);
+            output->render->emit_signal(wf::signals::workspace_stream_post, &data);
         }
     }
 
@@ -937,8 +1482,9 @@ wlr_box render_manager::get_ws_box(wf_point ws) const { return pimpl->output_dam
 wf_framebuffer render_manager::get_target_framebuffer() const { return pimpl->get_target_framebuffer(); }
 void render_manager::workspace_stream_start(workspace_stream_t& stream) { pimpl->workspace_stream_start(stream); }
 void render_manager::workspace_stream_update(workspace_stream_t& stream,
-    float scale_x, float scale_y){ pimpl->workspace_stream_update(stream); }
+    float scale_x, float scale_y){ pimpl->workspace_stream_update(stream, scale_x, scale_y); }
 void render_manager::workspace_stream_stop(workspace_stream_t& stream) { pimpl->workspace_stream_stop(stream); }
+std::vector<frame_statistics_t> render_manager::get_frame_statistics() const { return pimpl->frame_stats->get_history(); }
 
 } // namespace wf
 
@@ -7,6 +7,7 @@
 #include <signal-definitions.hpp>
 #include <opengl.hpp>
 #include <list>
+#include <functional>
 #include <algorithm>
 #include <nonstd/reverse.hpp>
 
@@ -15,18 +16,48 @@ namespace wf
 /**
  * output_layer_manager_t is a part of the workspace_manager module. It provides
  * the functionality related to layers.
+ *
+ * It also keeps an index of the views in each layer by workspace, so that the
+ * views on a workspace can be found without checking the geometry of all views.
+ * Each workspace has a bucket per layer, which contains the views whose wm
+ * geometry overlaps the workspace, in stacking order. Views with transformers
+ * and shell views are in all buckets. The buckets of a layer are rebuilt
+ * lazily, only after the stacking order or the workspaces of a view change.
  */
 class output_layer_manager_t
 {
     struct view_layer_data_t : public wf::custom_data_t
     {
         uint32_t layer = 0;
+
+        /* The range of workspaces whose buckets contain the view, in
+         * absolute workspace coordinates. Empty if first > last. */
+        wf_point first_ws = {0, 0};
+        wf_point last_ws = {-1, -1};
+
+        /* Connected to the view's signals while it is in a layer */
+        bool tracked = false;
+        signal_callback_t on_geometry_changed;
     };
 
     using layer_container = std::list<wayfire_view>;
     layer_container layers[TOTAL_LAYERS];
 
+    struct layer_index_t
+    {
+        /* Indexed by workspace, row by row */
+        std::vector<std::vector<wayfire_view>> buckets;
+        bool dirty = true;
+    } index[TOTAL_LAYERS];
+
+    output_t *output;
+
   public:
+    output_layer_manager_t(output_t *output)
+    {
+        this->output = output;
+    }
+
     constexpr int layer_index_from_mask(uint32_t layer_mask) const
     {
         return __builtin_ctz(layer_mask);
@@ -34,23 +65,13 @@ class output_layer_manager_t
 
     uint32_t& get_view_layer(wayfire_view view)
     {
-        return view->get_data_safe<view_layer_data_t>()->layer;
+        return view->get_slot_data_safe<view_layer_data_t>()->layer;
     }
 
     void remove_view(wayfire_view view)
     {
-        auto& view_layer = get_view_layer(view);
-        if (!view_layer)
-            return;
-
-        view->damage();
-        auto& layer_container = layers[layer_index_from_mask(view_layer)];
-
-        auto it = std::remove(
-            layer_container.begin(), layer_container.end(), view);
-        layer_container.erase(it, layer_container.end());
-
-        view_layer = 0;
+        unlink_view(view);
+        untrack_view(view);
     }
 
     /**
@@ -62,11 +83,15 @@ class output_layer_manager_t
         auto& current_layer = get_view_layer(view);
 
         if (current_layer)
-            remove_view(view);
+            unlink_view(view);
 
         auto& layer_container = layers[layer_index_from_mask(layer)];
         layer_container.push_front(view);
         current_layer = layer;
+        /* track_view() doesn't update the index of a view which is already
+         * tracked, so the new layer has to be rebuilt here */
+        mark_dirty(layer);
+        track_view(view);
         view->damage();
     }
 
@@ -75,7 +100,7 @@ class output_layer_manager_t
         uint32_t view_layer = get_view_layer(view);
         assert(view_layer > 0); // checked in workspace_manager::impl
 
-        remove_view(view);
+        unlink_view(view);
         add_view_to_layer(view, static_cast<layer_t>(view_layer));
     }
 
@@ -89,18 +114,20 @@ class output_layer_manager_t
 
     void restack_above(wayfire_view view, wayfire_view below)
     {
-        remove_view(view);
+        unlink_view(view);
         auto layer = get_view_layer(below);
         auto& container = layers[layer_index_from_mask(layer)];
         auto it = std::find(container.begin(), container.end(), below);
 
         container.insert(it, view);
         get_view_layer(view) = layer;
+        mark_dirty(layer);
+        track_view(view);
     }
 
     void restack_below(wayfire_view view, wayfire_view above)
     {
-        remove_view(view);
+        unlink_view(view);
         auto layer = get_view_layer(above);
         auto& container = layers[layer_index_from_mask(layer)];
         auto it = std::find(container.begin(), container.end(), above);
@@ -108,6 +135,8 @@ class output_layer_manager_t
 
         container.insert(std::next(it), view);
         get_view_layer(view) = layer;
+        mark_dirty(layer);
+        track_view(view);
     }
 
     std::vector<wayfire_view> get_views_in_layer(uint32_t layers_mask)
@@ -124,6 +153,183 @@ class output_layer_manager_t
 
         return views;
     }
+
+    /**
+     * @return The views of the layer with the given index which may be
+     * visible on the workspace ws, in stacking order. The result is a
+     * superset of the visible views, and it is invalidated by the next
+     * change of the layer.
+     */
+    const std::vector<wayfire_view>& get_views_in_bucket(int layer_idx,
+        wf_point ws)
+    {
+        auto& layer_index = index[layer_idx];
+        if (layer_index.dirty)
+            rebuild_index(layer_idx);
+
+        auto grid = output->workspace->get_workspace_grid_size();
+        return layer_index.buckets[ws.y * grid.width + ws.x];
+    }
+
+    /**
+     * Rebuild the index of all layers on the next query, for ex. when the
+     * workspace changes and the views which aren't moved with the workspace
+     * end up on a different one.
+     */
+    void invalidate_index()
+    {
+        for (auto& layer_index : index)
+            layer_index.dirty = true;
+    }
+
+  private:
+    /* Remove the view from its layer, without disconnecting from it */
+    void unlink_view(wayfire_view view)
+    {
+        auto& view_layer = get_view_layer(view);
+        if (!view_layer)
+            return;
+
+        view->damage();
+        auto& layer_container = layers[layer_index_from_mask(view_layer)];
+
+        auto it = std::remove(
+            layer_container.begin(), layer_container.end(), view);
+        layer_container.erase(it, layer_container.end());
+
+        mark_dirty(view_layer);
+        view_layer = 0;
+    }
+
+    void mark_dirty(uint32_t layer)
+    {
+        index[layer_index_from_mask(layer)].dirty = true;
+    }
+
+    /* Update the index when the view's geometry changes */
+    void track_view(wayfire_view view)
+    {
+        auto data = view->get_slot_data_safe<view_layer_data_t>();
+        if (data->tracked)
+            return;
+
+        data->on_geometry_changed = [=] (signal_data_t*)
+        {
+            update_view_workspaces(view);
+        };
+
+        view->connect_signal("geometry-changed", &data->on_geometry_changed);
+        view->connect_signal("decoration-changed", &data->on_geometry_changed);
+        view->connect_signal("transformer-changed", &data->on_geometry_changed);
+        data->tracked = true;
+
+        /* A view may be added to a layer while it has a different role or
+         * geometry than when it was last indexed */
+        update_view_workspaces(view);
+    }
+
+    void untrack_view(wayfire_view view)
+    {
+        auto data = view->get_slot_data_safe<view_layer_data_t>();
+        if (!data->tracked)
+            return;
+
+        view->disconnect_signal("geometry-changed", &data->on_geometry_changed);
+        view->disconnect_signal("decoration-changed", &data->on_geometry_changed);
+        view->disconnect_signal("transformer-changed", &data->on_geometry_changed);
+        data->tracked = false;
+    }
+
+    static int floor_div(int a, int b)
+    {
+        return a / b - (a % b < 0);
+    }
+
+    /* Calculate the range of workspaces the view may be visible on */
+    void calculate_view_workspaces(wayfire_view view,
+        wf_point& first_ws, wf_point& last_ws)
+    {
+        auto grid = output->workspace->get_workspace_grid_size();
+
+        /* Shell views are visible on all workspaces, and transformed views
+         * can be anywhere, visibility is checked after the lookup */
+        if (view->role == VIEW_ROLE_SHELL_VIEW || view->has_transformer())
+        {
+            first_ws = {0, 0};
+            last_ws = {grid.width - 1, grid.height - 1};
+            return;
+        }
+
+        auto g = output->get_relative_geometry();
+        auto cws = output->workspace->get_current_workspace();
+        auto wm = view->get_wm_geometry();
+        if (g.width <= 0 || g.height <= 0 || wm.width <= 0 || wm.height <= 0)
+        {
+            first_ws = {0, 0};
+            last_ws = {-1, -1};
+            return;
+        }
+
+        /* Absolute coordinates, relative to the first workspace */
+        int x1 = wm.x + cws.x * g.width;
+        int y1 = wm.y + cws.y * g.height;
+
+        first_ws.x = std::max(floor_div(x1, g.width), 0);
+        first_ws.y = std::max(floor_div(y1, g.height), 0);
+        last_ws.x = std::min(floor_div(x1 + wm.width - 1, g.width),
+            grid.width - 1);
+        last_ws.y = std::min(floor_div(y1 + wm.height - 1, g.height),
+            grid.height - 1);
+    }
+
+    void update_view_workspaces(wayfire_view view)
+    {
+        auto data = view->get_slot_data_safe<view_layer_data_t>();
+        if (!data->layer)
+            return;
+
+        wf_point first_ws, last_ws;
+        calculate_view_workspaces(view, first_ws, last_ws);
+        if (first_ws != data->first_ws || last_ws != data->last_ws)
+            mark_dirty(data->layer);
+    }
+
+    void rebuild_index(int layer_idx)
+    {
+        auto grid = output->workspace->get_workspace_grid_size();
+        auto& layer_index = index[layer_idx];
+        size_t capacity = get_index_capacity(layer_index);
+
+        /* Clearing the buckets keeps their memory */
+        layer_index.buckets.resize(grid.width * grid.height);
+        for (auto& bucket : layer_index.buckets)
+            bucket.clear();
+
+        for (auto& view : layers[layer_idx])
+        {
+            auto data = view->get_slot_data_safe<view_layer_data_t>();
+            calculate_view_workspaces(view, data->first_ws, data->last_ws);
+
+            for (int y = data->first_ws.y; y <= data->last_ws.y; y++)
+            {
+                for (int x = data->first_ws.x; x <= data->last_ws.x; x++)
+                    layer_index.buckets[y * grid.width + x].push_back(view);
+            }
+        }
+
+        layer_index.dirty = false;
+        if (get_index_capacity(layer_index) != capacity)
+            wf_note_cache_growth();
+    }
+
+    static size_t get_index_capacity(const layer_index_t& layer_index)
+    {
+        size_t capacity = layer_index.buckets.capacity();
+        for (auto& bucket : layer_index.buckets)
+            capacity += bucket.capacity();
+
+        return capacity;
+    }
 };
 
 struct default_workspace_implementation_t : public workspace_implementation_t
@@ -146,11 +352,14 @@ class output_viewport_manager_t
     int current_vy;
 
     output_t *output;
+    output_layer_manager_t *layer_manager;
 
   public:
-    output_viewport_manager_t(output_t *output)
+    output_viewport_manager_t(output_t *output,
+        output_layer_manager_t *layer_manager)
     {
         this->output = output;
+        this->layer_manager = layer_manager;
 
         auto section = wf::get_core().config->get_section("core");
 
@@ -224,19 +433,34 @@ class output_viewport_manager_t
     std::vector<wayfire_view> get_views_on_workspace(wf_point vp,
         uint32_t layers_mask, bool wm_only)
     {
-        /* get all views in the given layers */
-        std::vector<wayfire_view> views =
-            output->workspace->get_views_in_layer(layers_mask);
-
-        /* remove those which aren't visible on the workspace */
-        auto it = std::remove_if(views.begin(), views.end(), [&] (wayfire_view view) {
-            return !view_visible_on(view, vp, !wm_only);
-        });
-        views.erase(it, views.end());
+        std::vector<wayfire_view> views;
+        for_each_view_on_workspace(vp, layers_mask, wm_only,
+            [&] (wayfire_view view) { views.push_back(view); });
 
         return views;
     }
 
+    void for_each_view_on_workspace(wf_point vp, uint32_t layers_mask,
+        bool wm_only, const std::function<void(wayfire_view)>& func)
+    {
+        if (vp.x < 0 || vp.y < 0 || vp.x >= vwidth || vp.y >= vheight)
+            return;
+
+        for (int i = TOTAL_LAYERS - 1; i >= 0; i--)
+        {
+            if (!((1 << i) & layers_mask))
+                continue;
+
+            /* The bucket contains all views which may be visible, so we
+             * still need to check the actual geometry */
+            for (auto& view : layer_manager->get_views_in_bucket(i, vp))
+            {
+                if (view_visible_on(view, vp, !wm_only))
+                    func(view);
+            }
+        }
+    }
+
     wf_point get_current_workspace()
     {
         return {current_vx, current_vy};
@@ -285,6 +509,10 @@ class output_viewport_manager_t
                 v->get_wm_geometry().y + dy);
         }
 
+        /* Views in the other layers stayed in place, so they are now on
+         * different workspaces */
+        layer_manager->invalidate_index();
+
         output->emit_signal("viewport-changed", &data);
 
         /* unfocus view from last workspace */
@@ -429,6 +657,7 @@ class workspace_manager::impl
         }
 
         output_geometry = output->get_relative_geometry();
+        layer_manager.invalidate_index();
         workarea_manager.reflow_reserved_areas();
     };
 
@@ -437,6 +666,12 @@ class workspace_manager::impl
         check_autohide_panels();
     };
 
+    /* Views usually get their real geometry when they are mapped */
+    signal_callback_t view_mapped = [=] (signal_data_t *data)
+    {
+        layer_manager.invalidate_index();
+    };
+
     bool sent_autohide = false;
 
     std::unique_ptr<workspace_implementation_t> workspace_impl;
@@ -447,14 +682,15 @@ class workspace_manager::impl
     output_workarea_manager_t workarea_manager;
 
     impl(output_t *o) :
-        layer_manager(),
-        viewport_manager(o),
+        layer_manager(o),
+        viewport_manager(o, &layer_manager),
         workarea_manager(o)
     {
         output = o;
         output_geometry = output->get_relative_geometry();
 
         o->connect_signal("view-change-viewport", &view_changed_viewport);
+        o->connect_signal("map-view", &view_mapped);
         o->connect_signal("output-configuration-changed", &output_geometry_changed);
     }
 
@@ -654,6 +890,9 @@ workspace_manager::~workspace_manager() = default;
 bool workspace_manager::view_visible_on(wayfire_view view, wf_point ws) { return pimpl->viewport_manager.view_visible_on(view, ws, true); }
 std::vector<wayfire_view> workspace_manager::get_views_on_workspace(wf_point ws, uint32_t layer_mask, bool wm_only)
 { return pimpl->viewport_manager.get_views_on_workspace(ws, layer_mask, wm_only); }
+void workspace_manager::for_each_view_on_workspace(wf_point ws, uint32_t layer_mask, bool wm_only,
+    const std::function<void(wayfire_view)>& func)
+{ return pimpl->viewport_manager.for_each_view_on_workspace(ws, layer_mask, wm_only, func); }
 
 void workspace_manager::move_to_workspace(wayfire_view view, wf_point ws) { return pimpl->viewport_manager.move_to_workspace(view, ws); }
 
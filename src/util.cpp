@@ -1,7 +1,10 @@
 #include "util.hpp"
 #include <debug.hpp>
 #include <core.hpp>
+#include <cmath>
+#include <cstdlib>
 #include <ctime>
+#include <vector>
 
 extern "C"
 {
@@ -104,12 +107,114 @@ pixman_box32_t pixman_box_from_wlr_box(const wlr_box& box)
     };
 }
 
+namespace
+{
+/* Thread-local objects are destroyed before static ones, and static objects
+ * like core still destroy regions at exit. This flag doesn't have a
+ * destructor, so it stays valid and tells them the pool is gone. */
+thread_local bool region_storage_pool_destroyed = false;
+
+/* Keeps the rectangle storage of destroyed regions, see wf_region */
+struct region_storage_pool_t
+{
+    /* Limit the memory kept by the pool */
+    static constexpr size_t max_buffers = 32;
+    static constexpr long max_rects = 1024;
+
+    std::vector<pixman_region32_data_t*> buffers;
+
+    region_storage_pool_t()
+    {
+        buffers.reserve(max_buffers);
+    }
+
+    ~region_storage_pool_t()
+    {
+        for (auto data : buffers)
+            free(data);
+
+        region_storage_pool_destroyed = true;
+    }
+
+    /* Initialize an empty region, with pooled storage if there is any */
+    void init(pixman_region32_t *region)
+    {
+        if (buffers.empty())
+        {
+            pixman_region32_init(region);
+            return;
+        }
+
+        /* pixman treats a region with data but no rectangles as empty, and
+         * reuses the data if it can hold the result of an operation */
+        region->data = buffers.back();
+        region->data->numRects = 0;
+        region->extents = {0, 0, 0, 0};
+        buffers.pop_back();
+    }
+
+    void fini(pixman_region32_t *region)
+    {
+        /* Regions with at most one rectangle and empty regions use no storage
+         * or static storage, which has size 0 */
+        auto data = region->data;
+        if (data && data->size > 0 && data->size <= max_rects &&
+            buffers.size() < max_buffers)
+        {
+            buffers.push_back(data);
+        } else
+        {
+            pixman_region32_fini(region);
+        }
+    }
+};
+
+thread_local region_storage_pool_t region_storage_pool;
+
+/* Same as wlr_region_scale(), but doesn't allocate for regions with a single
+ * rectangle, which most opaque regions and damaged boxes are */
+void scale_region(pixman_region32_t *dst, pixman_region32_t *src, float scale)
+{
+    if (pixman_region32_n_rects(src) != 1)
+    {
+        wlr_region_scale(dst, src, scale);
+        return;
+    }
+
+    auto box = *pixman_region32_extents(src);
+    box.x1 = std::floor(box.x1 * scale);
+    box.y1 = std::floor(box.y1 * scale);
+    box.x2 = std::ceil(box.x2 * scale);
+    box.y2 = std::ceil(box.y2 * scale);
+
+    if (box.x1 < box.x2 && box.y1 < box.y2)
+    {
+        pixman_region32_reset(dst, &box);
+    } else
+    {
+        pixman_region32_clear(dst);
+    }
+}
+}
+
 wf_region::wf_region()
 {
     pixman_region32_init(&_region);
 }
 
-wf_region::wf_region(pixman_region32_t *region) : wf_region()
+wf_region::wf_region(recycled_t, bool recycle)
+{
+    if (recycle && !region_storage_pool_destroyed)
+    {
+        region_storage_pool.init(&_region);
+    } else
+    {
+        pixman_region32_init(&_region);
+    }
+}
+
+wf_region::wf_region(pixman_region32_t *region)
+    : wf_region(recycled_t{}, pixman_region32_n_rects(region) > 1)
 {
     pixman_region32_copy(this->to_pixman(), region);
 }
@@ -121,10 +226,17 @@ wf_region::wf_region(const wlr_box& box)
 
 wf_region:: ~wf_region()
 {
-    pixman_region32_fini(&_region);
+    if (region_storage_pool_destroyed)
+    {
+        pixman_region32_fini(&_region);
+    } else
+    {
+        region_storage_pool.fini(&_region);
+    }
 }
 
-wf_region::wf_region(const wf_region& other) : wf_region()
+wf_region::wf_region(const wf_region& other)
+    : wf_region(recycled_t{}, pixman_region32_n_rects(other.unconst()) > 1)
 {
     pixman_region32_copy(this->to_pixman(), other.unconst());
 }
@@ -181,124 +293,168 @@ bool wf_region::contains_point(const wf_point& point) const
 }
 
 /* Translate the region */
-wf_region wf_region::operator + (const wf_point& vector) const
+wf_region wf_region::operator + (const wf_point& vector) const &
 {
     wf_region result{*this};
     pixman_region32_translate(&result._region, vector.x, vector.y);
     return result;
 }
 
+wf_region wf_region::operator + (const wf_point& vector) &&
+{
+    *this += vector;
+    return std::move(*this);
+}
+
 wf_region& wf_region::operator += (const wf_point& vector)
 {
     pixman_region32_translate(&_region, vector.x, vector.y);
     return *this;
 }
 
-wf_region wf_region::operator * (float scale) const
+wf_region wf_region::operator * (float scale) const &
 {
     wf_region result;
-    wlr_region_scale(result.to_pixman(), this->unconst(), scale);
+    scale_region(result.to_pixman(), this->unconst(), scale);
     return result;
 }
 
+wf_region wf_region::operator * (float scale) &&
+{
+    *this *= scale;
+    return std::move(*this);
+}
+
 wf_region& wf_region::operator *= (float scale)
 {
-    wlr_region_scale(this->to_pixman(), this->to_pixman(), scale);
+    scale_region(this->to_pixman(), this->to_pixman(), scale);
     return *this;
 }
 
+/* The in-place operators compute the result in a new region and swap it with
+ * this one, because pixman allocates new storage for operations whose
+ * destination is also a source. The old storage goes back to the pool.
+ *
+ * Intersections and copies of regions with a single rectangle have a single
+ * rectangle too, and pixman would free pooled storage, so they don't take any. */
+
 /* Region intersection */
-wf_region wf_region::operator & (const wlr_box& box) const
+wf_region wf_region::operator & (const wlr_box& box) const &
 {
-    wf_region result;
+    wf_region result{recycled_t{}, pixman_region32_n_rects(unconst()) > 1};
     pixman_region32_intersect_rect(result.to_pixman(), this->unconst(),
         box.x, box.y, box.width, box.height);
 
     return result;
 }
 
-wf_region wf_region::operator & (const wf_region& other) const
+wf_region wf_region::operator & (const wlr_box& box) &&
 {
-    wf_region result;
+    *this &= box;
+    return std::move(*this);
+}
+
+wf_region wf_region::operator & (const wf_region& other) const &
+{
+    wf_region result{recycled_t{}, pixman_region32_n_rects(unconst()) > 1 ||
+        pixman_region32_n_rects(other.unconst()) > 1};
     pixman_region32_intersect(result.to_pixman(),
         this->unconst(), other.unconst());
 
     return result;
 }
 
+wf_region wf_region::operator & (const wf_region& other) &&
+{
+    *this &= other;
+    return std::move(*this);
+}
+
 wf_region& wf_region::operator &= (const wlr_box& box)
 {
-    pixman_region32_intersect_rect(this->to_pixman(), this->to_pixman(),
-        box.x, box.y, box.width, box.height);
-    return *this;
+    return *this = *this & box;
 }
 
 wf_region& wf_region::operator &= (const wf_region& other)
 {
-    pixman_region32_intersect(this->to_pixman(),
-        this->to_pixman(), other.unconst());
-    return *this;
+    return *this = *this & other;
 }
 
 /* Region union */
-wf_region wf_region::operator | (const wlr_box& other) const
+wf_region wf_region::operator | (const wlr_box& other) const &
 {
-    wf_region result;
+    wf_region result{recycled_t{}, true};
     pixman_region32_union_rect(result.to_pixman(), this->unconst(),
         other.x, other.y, other.width, other.height);
     return result;
 }
 
-wf_region wf_region::operator | (const wf_region& other) const
+wf_region wf_region::operator | (const wlr_box& other) &&
 {
-    wf_region result;
+    *this |= other;
+    return std::move(*this);
+}
+
+wf_region wf_region::operator | (const wf_region& other) const &
+{
+    wf_region result{recycled_t{}, true};
     pixman_region32_union(result.to_pixman(), this->unconst(), other.unconst());
     return result;
 }
 
+wf_region wf_region::operator | (const wf_region& other) &&
+{
+    *this |= other;
+    return std::move(*this);
+}
+
 wf_region& wf_region::operator |= (const wlr_box& other)
 {
-    pixman_region32_union_rect(this->to_pixman(), this->to_pixman(),
-        other.x, other.y, other.width, other.height);
-    return *this;
+    return *this = *this | other;
 }
 
 wf_region& wf_region::operator |= (const wf_region& other)
 {
-    pixman_region32_union(this->to_pixman(), this->to_pixman(), other.unconst());
-    return *this;
+    return *this = *this | other;
 }
 
 /* Subtract the box/region from the current region */
-wf_region wf_region::operator ^ (const wlr_box& box) const
+wf_region wf_region::operator ^ (const wlr_box& box) const &
 {
-    wf_region result;
+    wf_region result{recycled_t{}, true};
     wf_region sub{box};
     pixman_region32_subtract(result.to_pixman(), this->unconst(), sub.to_pixman());
     return result;
 }
 
-wf_region wf_region::operator ^ (const wf_region& other) const
+wf_region wf_region::operator ^ (const wlr_box& box) &&
 {
-    wf_region result;
+    *this ^= box;
+    return std::move(*this);
+}
+
+wf_region wf_region::operator ^ (const wf_region& other) const &
+{
+    wf_region result{recycled_t{}, true};
     pixman_region32_subtract(result.to_pixman(),
         this->unconst(), other.unconst());
     return result;
 }
 
+wf_region wf_region::operator ^ (const wf_region& other) &&
+{
+    *this ^= other;
+    return std::move(*this);
+}
+
 wf_region& wf_region::operator ^= (const wlr_box& box)
 {
-    wf_region sub{box};
-    pixman_region32_subtract(this->to_pixman(),
-        this->to_pixman(), sub.to_pixman());
-    return *this;
+    return *this = *this ^ box;
 }
 
 wf_region& wf_region::operator ^= (const wf_region& other)
 {
-    pixman_region32_subtract(this->to_pixman(),
-        this->to_pixman(), other.unconst());
-    return *this;
+    return *this = *this ^ other;
 }
 
 pixman_region32_t *wf_region::to_pixman()
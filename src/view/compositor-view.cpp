@@ -102,7 +102,7 @@ void wf::mirror_view_t::move(int x, int y)
     this->y = y;
 
     damage();
-    emit_signal("geometry-changed", &data);
+    emit_signal(wf::signals::geometry_changed, &data);
 }
 
 wf_geometry wf::mirror_view_t::get_output_geometry()
@@ -238,7 +238,7 @@ void wf::color_rect_view_t::move(int x, int y)
     this->geometry.y = y;
 
     damage();
-    emit_signal("geometry-changed", &data);
+    emit_signal(wf::signals::geometry_changed, &data);
 }
 
 void wf::color_rect_view_t::resize(int w, int h)
@@ -251,7 +251,7 @@ void wf::color_rect_view_t::resize(int w, int h)
     this->geometry.height = h;
 
     damage();
-    emit_signal("geometry-changed", &data);
+    emit_signal(wf::signals::geometry_changed, &data);
 }
 
 wf_geometry wf::color_rect_view_t::get_output_geometry()
@@ -21,6 +21,33 @@ class surface_interface_t::impl
     wf::output_t *output;
     int ref_cnt = 0;
 
+    /**
+     * The mapped surfaces of the surface tree, flattened from the bottom-most
+     * one, with the index of their parent in the list. The first entry is
+     * always the surface itself, even if it isn't mapped.
+     *
+     * The positions are relative to the surface and are updated on each
+     * traversal, since surfaces don't notify about offset changes.
+     */
+    struct surface_list_entry_t
+    {
+        surface_interface_t *surface;
+        int parent;
+        wf_point position;
+    };
+
+    std::vector<surface_list_entry_t> surface_list;
+    bool surface_list_dirty = true;
+    /* Number of for_each_surface() calls running for this surface */
+    int traversals = 0;
+
+    /**
+     * Rebuild the surface list of this surface and all of its ancestors on
+     * their next traversal. Called when a surface in the tree is mapped,
+     * unmapped, added, removed or restacked.
+     */
+    void invalidate_surface_list();
+
     static int active_shrink_constraint;
 
     /**
@@ -35,6 +35,7 @@ wf::surface_interface_t::surface_interface_t(surface_interface_t *parent)
         set_output(parent->get_output());
         parent->priv->surface_children.insert(
             parent->priv->surface_children.begin(), this);
+        parent->priv->invalidate_surface_list();
     }
 }
 
@@ -45,6 +46,7 @@ wf::surface_interface_t::~surface_interface_t()
         auto& container = priv->parent_surface->priv->surface_children;
         auto it = std::remove(container.begin(), container.end(), this);
         container.erase(it, container.end());
+        priv->parent_surface->priv->invalidate_surface_list();
     }
 
     for (auto c : priv->surface_children)
@@ -75,22 +77,112 @@ std::vector<wf::surface_iterator_t> wf::surface_interface_t::enumerate_surfaces(
     wf_point surface_origin)
 {
     std::vector<wf::surface_iterator_t> result;
-    for (auto& child : priv->surface_children)
+    for_each_surface([&] (const surface_iterator_t& child)
     {
+        result.push_back(child);
+    }, surface_origin);
+
+    return result;
+}
+
+void wf::surface_interface_t::impl::invalidate_surface_list()
+{
+    for (auto surface = this; surface;)
+    {
+        surface->surface_list_dirty = true;
+        surface = surface->parent_surface ?
+            surface->parent_surface->priv.get() : nullptr;
+    }
+}
+
+/* Add the mapped surfaces of the tree of surface to list, from the bottom-most
+ * one */
+static void flatten_surface_tree(wf::surface_interface_t *surface, int parent,
+    std::vector<wf::surface_interface_t::impl::surface_list_entry_t>& list)
+{
+    int index = list.size();
+    list.push_back({surface, parent, {0, 0}});
+
+    auto& children = surface->priv->surface_children;
+    for (auto it = children.rbegin(); it != children.rend(); ++it)
+    {
+        if ((*it)->is_mapped())
+            flatten_surface_tree(*it, index, list);
+    }
+}
+
+/* Traverse the surface tree without the surface list, used when the list
+ * can't be rebuilt because it is being traversed */
+template<class Visitor>
+static void visit_surfaces_uncached(wf::surface_interface_t *surface,
+    Visitor visitor, void *data, wf_point origin, bool bottom_up)
+{
+    if (bottom_up && surface->is_mapped())
+        visitor(data, {surface, origin});
+
+    auto& children = surface->priv->surface_children;
+    for (size_t i = 0; i < children.size(); i++)
+    {
+        auto child = children[bottom_up ? children.size() - i - 1 : i];
         if (child->is_mapped())
         {
-            auto child_surfaces = child->enumerate_surfaces(
-                child->get_offset() + surface_origin);
+            visit_surfaces_uncached(child, visitor, data,
+                origin + child->get_offset(), bottom_up);
+        }
+    }
+
+    if (!bottom_up && surface->is_mapped())
+        visitor(data, {surface, origin});
+}
 
-            result.insert(result.end(),
-                child_surfaces.begin(), child_surfaces.end());
+void wf::surface_interface_t::visit_surfaces(surface_visitor_t visitor,
+    void *data, wf_point surface_origin, bool bottom_up)
+{
+    if (priv->surface_list_dirty)
+    {
+        /* A surface was mapped or unmapped by func during a traversal */
+        if (priv->traversals > 0)
+        {
+            visit_surfaces_uncached(this, visitor, data, surface_origin,
+                bottom_up);
+            return;
         }
+
+        size_t capacity = priv->surface_list.capacity();
+        priv->surface_list.clear();
+        flatten_surface_tree(this, -1, priv->surface_list);
+        priv->surface_list_dirty = false;
+
+        if (priv->surface_list.capacity() != capacity)
+            wf_note_cache_growth();
     }
 
-    if (is_mapped())
-        result.push_back({this, surface_origin});
+    /* Nested traversals with another origin compute the same relative
+     * positions, so they don't disturb the running ones */
+    auto& list = priv->surface_list;
+    for (size_t i = 1; i < list.size(); i++)
+    {
+        list[i].position = list[list[i].parent].position +
+            list[i].surface->get_offset();
+    }
 
-    return result;
+    /* The first entry is this surface, which is visited only if mapped */
+    size_t first = is_mapped() ? 0 : 1;
+    ++priv->traversals;
+    if (bottom_up)
+    {
+        for (size_t i = first; i < list.size(); i++)
+            visitor(data, {list[i].surface, list[i].position + surface_origin});
+    } else
+    {
+        for (size_t i = list.size(); i > first; i--)
+        {
+            visitor(data,
+                {list[i - 1].surface, list[i - 1].position + surface_origin});
+        }
+    }
+
+    --priv->traversals;
 }
 
 wf::output_t *wf::surface_interface_t::get_output()
@@ -234,6 +326,8 @@ wf_size_t wf::wlr_surface_base_t::_get_size() const
 
 void wf::emit_map_state_change(wf::surface_interface_t *surface)
 {
+    surface->priv->invalidate_surface_list();
+
     std::string state = surface->is_mapped() ? "_surface_mapped" : "_surface_unmapped";
 
     _surface_map_state_changed_signal data;
@@ -295,8 +389,13 @@ wlr_buffer* wf::wlr_surface_base_t::get_buffer()
 void wf::wlr_surface_base_t::damage_surface_region(
     const wf_region& dmg)
 {
-    for (const auto& rect : dmg)
-        damage_surface_box(wlr_box_from_pixman_box(rect));
+    auto parent =
+        dynamic_cast<wlr_surface_base_t*> (_as_si->priv->parent_surface);
+
+    /* Same as damage_surface_box(), but the whole region is passed up the
+     * surface tree at once, so that the view damages the output only once */
+    if (parent && parent->_is_mapped())
+        parent->damage_surface_region(dmg + _as_si->get_offset());
 }
 
 void wf::wlr_surface_base_t::damage_surface_box(const wlr_box& box)
@@ -388,6 +487,8 @@ void wf::wlr_surface_base_t::_wlr_render_box(
 void wf::wlr_surface_base_t::_simple_render(const wf_framebuffer& fb,
     int x, int y, const wf_region& damage)
 {
+    /* The render_begin() of each box is nested in the pass */
+    OpenGL::render_pass_t pass{fb};
     for (const auto& rect : damage)
     {
         auto box = wlr_box_from_pixman_box(rect);
@@ -28,6 +28,8 @@ wlr_box wf_view_transformer_t::get_bounding_box(wf_geometry view, wlr_box region
 void wf_view_transformer_t::render_with_damage(uint32_t src_tex, wlr_box src_box,
             const wf_region& damage, const wf_framebuffer& target_fb)
 {
+    /* The render_begin() of each box is nested in the pass */
+    OpenGL::render_pass_t pass{target_fb};
     for (const auto& rect : damage)
     {
         auto box = target_fb.framebuffer_box_from_damage_box(
@@ -36,6 +38,29 @@ void wf_view_transformer_t::render_with_damage(uint32_t src_tex, wlr_box src_box
     }
 }
 
+wf_region wf_view_transformer_t::transform_damage(wf_geometry view,
+    const wf_region& damage)
+{
+    return get_bounding_box(view, view);
+}
+
+wf_region wf_view_transformer_t::transform_damage_boxes(wf_geometry view,
+    const wf_region& damage)
+{
+    wf_region result;
+    for (const auto& rect : damage)
+    {
+        /* Expand the boxes by a pixel, because of texture filtering and
+         * because get_bounding_box() truncates the coordinates */
+        auto box = wlr_box_from_pixman_box(rect);
+        box = get_bounding_box(view,
+            {box.x - 1, box.y - 1, box.width + 2, box.height + 2});
+        result |= wlr_box{box.x - 1, box.y - 1, box.width + 2, box.height + 2};
+    }
+
+    return result;
+}
+
 struct transformable_quad
 {
     gl_geometry geometry;
@@ -132,8 +157,8 @@ wf_pointf wf_2D_view::transformed_to_local_point(wf_geometry geometry, wf_pointf
     return get_absolute_coords_from_relative(view->get_wm_geometry(), {x, y});
 }
 
-void wf_2D_view::render_box(uint32_t src_tex, wlr_box src_box,
-    wlr_box scissor_box, const wf_framebuffer& fb)
+glm::mat4 wf_2D_view::calculate_render_transform(wlr_box src_box,
+    const wf_framebuffer& fb, gl_geometry& geometry)
 {
     auto quad = center_geometry(fb.geometry, src_box, get_center(view->get_wm_geometry()));
 
@@ -150,15 +175,55 @@ void wf_2D_view::render_box(uint32_t src_tex, wlr_box src_box,
     auto ortho = glm::ortho(-fb.geometry.width  / 2.0f, fb.geometry.width  / 2.0f,
                             -fb.geometry.height / 2.0f, fb.geometry.height / 2.0f);
 
-    auto transform = fb.transform * ortho * translate * rotate;
+    geometry = quad.geometry;
+    return fb.transform * ortho * translate * rotate;
+}
+
+void wf_2D_view::render_box(uint32_t src_tex, wlr_box src_box,
+    wlr_box scissor_box, const wf_framebuffer& fb)
+{
+    gl_geometry geometry;
+    auto transform = calculate_render_transform(src_box, fb, geometry);
 
     OpenGL::render_begin(fb);
-    fb.scissor(scissor_box);
-    OpenGL::render_transformed_texture(src_tex, quad.geometry, {},
-                                       transform, {1.0f, 1.0f, 1.0f, alpha});
+    OpenGL::texture_batch_t batch{src_tex, transform, {1.0f, 1.0f, 1.0f, alpha}};
+    batch.add_quad(geometry, {}, fb, scissor_box);
+    batch.flush();
     OpenGL::render_end();
 }
 
+void wf_2D_view::render_with_damage(uint32_t src_tex, wlr_box src_box,
+    const wf_region& damage, const wf_framebuffer& fb)
+{
+    gl_geometry geometry;
+    auto transform = calculate_render_transform(src_box, fb, geometry);
+
+    OpenGL::render_begin(fb);
+    OpenGL::texture_batch_t batch{src_tex, transform, {1.0f, 1.0f, 1.0f, alpha}};
+    batch.add_quad(geometry, {}, fb, damage);
+    batch.flush();
+    OpenGL::render_end();
+}
+
+wf_region wf_2D_view::transform_damage(wf_geometry geometry,
+    const wf_region& damage)
+{
+    auto transform =
+        glm::translate(glm::mat4(1.0), {translation_x, translation_y, 0}) *
+        glm::rotate(glm::mat4(1.0), angle, {0, 0, 1}) *
+        glm::scale(glm::mat4(1.0), {scale_x, scale_y, 1});
+
+    /* If the parameters changed, the whole result is different */
+    bool changed = (transform != last_transform || alpha != last_alpha);
+    last_transform = transform;
+    last_alpha = alpha;
+
+    if (changed)
+        return get_bounding_box(geometry, geometry);
+
+    return transform_damage_boxes(geometry, damage);
+}
+
 const float wf_3D_view::fov = PI/4;
 glm::mat4 wf_3D_view::default_view_matrix()
 {
@@ -206,8 +271,8 @@ wf_pointf wf_3D_view::transformed_to_local_point(wf_geometry geometry, wf_pointf
         wf::compositor_core_t::invalid_coordinate};
 }
 
-void wf_3D_view::render_box(uint32_t src_tex, wlr_box src_box,
-    wlr_box scissor_box, const wf_framebuffer& fb)
+glm::mat4 wf_3D_view::calculate_render_transform(wlr_box src_box,
+    const wf_framebuffer& fb, gl_geometry& geometry)
 {
     auto quad = center_geometry(fb.geometry, src_box, get_center(src_box));
 
@@ -219,11 +284,48 @@ void wf_3D_view::render_box(uint32_t src_tex, wlr_box src_box,
                                 1.0
                             });
 
-    transform = fb.transform * scale * translate * transform;
+    geometry = quad.geometry;
+    return fb.transform * scale * translate * transform;
+}
+
+void wf_3D_view::render_box(uint32_t src_tex, wlr_box src_box,
+    wlr_box scissor_box, const wf_framebuffer& fb)
+{
+    gl_geometry geometry;
+    auto transform = calculate_render_transform(src_box, fb, geometry);
+
+    OpenGL::render_begin(fb);
+    OpenGL::texture_batch_t batch{src_tex, transform, color};
+    batch.add_quad(geometry, {}, fb, scissor_box);
+    batch.flush();
+    OpenGL::render_end();
+}
+
+void wf_3D_view::render_with_damage(uint32_t src_tex, wlr_box src_box,
+    const wf_region& damage, const wf_framebuffer& fb)
+{
+    gl_geometry geometry;
+    auto transform = calculate_render_transform(src_box, fb, geometry);
 
     OpenGL::render_begin(fb);
-    fb.scissor(scissor_box);
-    OpenGL::render_transformed_texture(src_tex, quad.geometry, {},
-                                       transform, color);
+    OpenGL::texture_batch_t batch{src_tex, transform, color};
+    batch.add_quad(geometry, {}, fb, damage);
+    batch.flush();
     OpenGL::render_end();
 }
+
+wf_region wf_3D_view::transform_damage(wf_geometry geometry,
+    const wf_region& damage)
+{
+    auto transform = calculate_total_transform();
+
+    /* If the parameters changed, the whole result is different */
+    bool changed = (transform != last_transform || color != last_color);
+    last_transform = transform;
+    last_color = color;
+
+    if (changed)
+        return get_bounding_box(geometry, geometry);
+
+    return transform_damage_boxes(geometry, damage);
+}
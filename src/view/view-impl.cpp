@@ -36,6 +36,12 @@ void wf::wlr_view_t::damage_surface_box(const wlr_box& box)
     damage_box(damaged);
 }
 
+void wf::wlr_view_t::damage_surface_region(const wf_region& region)
+{
+    auto obox = get_output_geometry();
+    damage_region(region + wf_point{obox.x, obox.y});
+}
+
 void wf::wlr_view_t::handle_app_id_changed(std::string new_app_id)
 {
     this->app_id = new_app_id;
@@ -143,7 +149,7 @@ void wf::wlr_view_t::set_position(int x, int y,
     damage();
 
     if (send_signal)
-        emit_signal("geometry-changed", &data);
+        emit_signal(wf::signals::geometry_changed, &data);
 
     last_bounding_box = get_bounding_box();
 }
@@ -194,7 +200,7 @@ void wf::wlr_view_t::update_size()
     /* Damage new size */
     last_bounding_box = get_bounding_box();
     damage_raw(last_bounding_box);
-    emit_signal("geometry-changed", &data);
+    emit_signal(wf::signals::geometry_changed, &data);
 
     if (view_impl->frame)
         view_impl->frame->notify_view_resized(get_wm_geometry());
@@ -24,6 +24,9 @@ struct view_transform_block_t : public noncopyable_t
     std::string plugin_name = "";
     std::unique_ptr<wf_view_transformer_t> transform;
     wf_framebuffer fb;
+    /* Whether fb contains the result of the transform from the last time it
+     * was rendered, so that only the damaged parts need to be repainted */
+    bool fb_valid = false;
 
     view_transform_block_t();
     ~view_transform_block_t();
@@ -62,6 +65,9 @@ class view_interface_t::view_priv_impl
     struct offscreen_buffer_t : public wf_framebuffer
     {
         wf_region cached_damage;
+        /* Parts of the snapshot which were repainted but not yet passed
+         * through the transformers, relative to the snapshot geometry */
+        wf_region transformer_damage;
         bool valid() { return this->fb != (uint32_t)-1; }
     } offscreen_buffer;
 };
@@ -88,6 +94,7 @@ class wlr_view_t :
      * the surface is positioned at (x, y) */
     virtual void subtract_opaque(wf_region& region, int x, int y) override final;
     virtual void damage_surface_box(const wlr_box& box) override final;
+    virtual void damage_surface_region(const wf_region& region) override final;
 
     /* Functions which are further specialized for the different shells */
     virtual void move(int x, int y) override;
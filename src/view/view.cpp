@@ -221,19 +221,26 @@ wf::surface_interface_t *wf::view_interface_t::map_input_coordinates(
     auto view_relative_coordinates =
         global_to_local_point(cursor, nullptr);
 
-    for (auto& child : enumerate_surfaces({0, 0}))
+    wf::surface_interface_t *focus = nullptr;
+    for_each_surface([&] (const wf::surface_iterator_t& child)
     {
-        local.x = view_relative_coordinates.x - child.position.x;
-        local.y = view_relative_coordinates.y - child.position.y;
+        if (focus)
+            return;
+
+        wf_pointf child_local = {
+            view_relative_coordinates.x - child.position.x,
+            view_relative_coordinates.y - child.position.y,
+        };
 
         if (child.surface->accepts_input(
-                std::floor(local.x), std::floor(local.y)))
+                std::floor(child_local.x), std::floor(child_local.y)))
         {
-            return child.surface;
+            focus = child.surface;
+            local = child_local;
         }
-    }
+    });
 
-    return nullptr;
+    return focus;
 }
 
 bool wf::view_interface_t::is_focuseable() const
@@ -497,10 +504,11 @@ void wf::view_interface_t::set_decoration(surface_interface_t *frame)
     assert(frame);
 
     /* Move the decoration as the last child surface */
-    auto container = this->priv->surface_children;
+    auto& container = this->priv->surface_children;
     auto it = std::remove(container.begin(), container.end(), frame);
-    container.erase(it);
+    container.erase(it, container.end());
     container.push_back(frame);
+    this->priv->invalidate_surface_list();
 
     /* Calculate the wm geometry of the view after adding the decoration.
      *
@@ -559,7 +567,11 @@ void wf::view_interface_t::add_transformer(
         return view_impl->transforms.INSERT_NONE;
     });
 
+    /* The transforms after the new one now have a different input */
+    view_impl->transforms.for_each([] (auto& tr) { tr->fb_valid = false; });
+
     damage();
+    emit_signal("transformer-changed", nullptr);
 }
 
 nonstd::observer_ptr<wf_view_transformer_t>
@@ -583,11 +595,15 @@ void wf::view_interface_t::pop_transformer(
         return tr->transform.get() == transformer.get();
     });
 
+    /* The transforms after the removed one now have a different input */
+    view_impl->transforms.for_each([] (auto& tr) { tr->fb_valid = false; });
+
     /* Since we can remove transformers while rendering the output, damaging it
      * won't help at this stage (damage is already calculated).
      *
      * Instead, we directly damage the whole output for the next frame */
     get_output()->render->damage_whole_idle();
+    emit_signal("transformer-changed", nullptr);
 }
 
 void wf::view_interface_t::pop_transformer(std::string name)
@@ -608,12 +624,12 @@ wf_geometry wf::view_interface_t::get_untransformed_bounding_box()
     auto bbox = get_output_geometry();
     wf_region bounding_region = bbox;
 
-    for (auto& child : enumerate_surfaces({bbox.x, bbox.y}))
+    for_each_surface([&] (const wf::surface_iterator_t& child)
     {
         auto dim = child.surface->get_size();
         bounding_region |= {child.position.x, child.position.y,
             dim.width, dim.height};
-    };
+    }, {bbox.x, bbox.y});
 
     return wlr_box_from_pixman_box(bounding_region.get_extents());
 }
@@ -683,18 +699,19 @@ bool wf::view_interface_t::intersects_region(const wlr_box& region)
     if (!is_mapped())
         return region & get_bounding_box();
 
+    bool intersects = false;
     auto origin = get_output_geometry();
-    for (auto& child : enumerate_surfaces({origin.x, origin.y}))
+    for_each_surface([&] (const wf::surface_iterator_t& child)
     {
         wlr_box box = {child.position.x, child.position.y,
             child.surface->get_size().width, child.surface->get_size().height};
         box = transform_region(box);
 
         if (region & box)
-            return true;
-    }
+            intersects = true;
+    }, {origin.x, origin.y});
 
-    return false;
+    return intersects;
 }
 
 bool wf::view_interface_t::render_transformed(const wf_framebuffer& framebuffer,
@@ -726,6 +743,12 @@ bool wf::view_interface_t::render_transformed(const wf_framebuffer& framebuffer,
     /* final_transform is the one that should render to the screen */
     std::shared_ptr<view_transform_block_t> final_transform = nullptr;
 
+    /* The damage of the previous buffer in the chain, in the same coordinate
+     * system as obox */
+    wf_region chain_damage = offscreen_buffer.transformer_damage +
+        wf_point{obox.x, obox.y};
+    offscreen_buffer.transformer_damage.clear();
+
     transforms.for_each([&] (auto& transform) -> void
     {
         /* Last transform is handled separately */
@@ -741,18 +764,40 @@ bool wf::view_interface_t::render_transformed(const wf_framebuffer& framebuffer,
 
         /* Prepare buffer to store result after the transform */
         OpenGL::render_begin();
-        transform->fb.allocate(transformed_box.width, transformed_box.height);
+        bool full_repaint = transform->fb.allocate(transformed_box.width,
+            transformed_box.height);
+        full_repaint |= !transform->fb_valid ||
+            transform->fb.geometry != transformed_box;
         transform->fb.geometry = transformed_box;
+
+        /* Repaint only the parts of the buffer affected by the damage of the
+         * previous one, the rest is still valid from the last frame */
+        chain_damage =
+            transform->transform->transform_damage(obox, chain_damage);
+        if (full_repaint)
+            chain_damage = transformed_box;
+        chain_damage &= transformed_box;
+
+        auto local_damage =
+            chain_damage + wf_point{-transformed_box.x, -transformed_box.y};
+
         transform->fb.bind(); // bind buffer to clear it
-        OpenGL::clear({0, 0, 0, 0});
+        for (const auto& rect : local_damage)
+        {
+            transform->fb.scissor(transform->fb.framebuffer_box_from_damage_box(
+                    wlr_box_from_pixman_box(rect)));
+            OpenGL::clear({0, 0, 0, 0});
+        }
         OpenGL::render_end();
 
         /* Actually render the transform to the next framebuffer */
-        wf_region whole_region{wlr_box{0, 0,
-            transformed_box.width, transformed_box.height}};
-        transform->transform->render_with_damage(previous_texture, obox,
-            whole_region, transform->fb);
+        if (!local_damage.empty())
+        {
+            transform->transform->render_with_damage(previous_texture, obox,
+                local_damage, transform->fb);
+        }
 
+        transform->fb_valid = true;
         previous_transform = transform;
         previous_texture = previous_transform->fb.tex;
         obox = transformed_box;
@@ -775,13 +820,14 @@ bool wf::view_interface_t::render_transformed(const wf_framebuffer& framebuffer,
             1.0f * obox.y + 1.0f * obox.height,
         };
 
+        OpenGL::texture_batch_t batch{previous_texture, matrix};
         for (const auto& rect : damage)
         {
-            framebuffer.scissor(wlr_box_from_pixman_box(rect));
-            OpenGL::render_transformed_texture(previous_texture, src_geometry,
-                {}, matrix);
+            batch.add_quad(src_geometry, {}, framebuffer,
+                wlr_box_from_pixman_box(rect));
         }
 
+        batch.flush();
         OpenGL::render_end();
     } else
     {
@@ -810,39 +856,61 @@ void wf::view_interface_t::take_snapshot()
     auto& offscreen_buffer = view_impl->offscreen_buffer;
 
     auto buffer_geometry = get_untransformed_bounding_box();
-    offscreen_buffer.geometry = buffer_geometry;
-
     float scale = get_output()->handle->scale;
 
+    /* The snapshot is moved together with the view, so its contents stay
+     * valid as long as the bounding box and the scale are the same */
+    bool full_repaint = !offscreen_buffer.valid() ||
+        offscreen_buffer.scale != scale ||
+        offscreen_buffer.geometry != buffer_geometry;
+    offscreen_buffer.geometry = buffer_geometry;
+
     /* Nothing has changed, the last buffer is still valid */
-    if (offscreen_buffer.cached_damage.empty())
+    if (!full_repaint && offscreen_buffer.cached_damage.empty())
         return;
 
-    /* TODO: use offscreen buffer better */
-    offscreen_buffer.cached_damage.clear();
-
     OpenGL::render_begin();
-    offscreen_buffer.allocate(buffer_geometry.width * scale,
-        buffer_geometry.height * scale);
+    if (offscreen_buffer.allocate(buffer_geometry.width * scale,
+            buffer_geometry.height * scale))
+    {
+        full_repaint = true;
+    }
+    OpenGL::render_end();
 
     offscreen_buffer.scale = scale;
-    offscreen_buffer.bind();
-    OpenGL::clear({0, 0, 0, 0});
-    OpenGL::render_end();
 
     wf_region full_region{{0, 0, offscreen_buffer.viewport_width,
         offscreen_buffer.viewport_height}};
 
+    /* Repaint only the parts of the snapshot which were damaged since the
+     * last time it was taken */
+    wf_region damage = full_region;
+    if (!full_repaint)
+        damage &= offscreen_buffer.cached_damage * scale;
+
+    offscreen_buffer.transformer_damage |= full_repaint ?
+        wf_region{{0, 0, buffer_geometry.width, buffer_geometry.height}} :
+        offscreen_buffer.cached_damage;
+    offscreen_buffer.cached_damage.clear();
+
+    /* All surfaces are rendered to the snapshot in a single pass */
+    OpenGL::render_pass_t pass{offscreen_buffer};
+    for (const auto& rect : damage)
+    {
+        offscreen_buffer.scissor(offscreen_buffer.framebuffer_box_from_damage_box(
+                wlr_box_from_pixman_box(rect)));
+        OpenGL::clear({0, 0, 0, 0});
+    }
+
     auto output_geometry = get_output_geometry();
     int ox = output_geometry.x - buffer_geometry.x;
     int oy = output_geometry.y - buffer_geometry.y;
 
-    auto children = enumerate_surfaces({ox, oy});
-    for (auto& child : wf::reverse(children))
+    for_each_surface([&] (const wf::surface_iterator_t& child)
     {
         child.surface->simple_render(offscreen_buffer,
-            child.position.x, child.position.y, full_region);
-    }
+            child.position.x, child.position.y, damage);
+    }, {ox, oy}, true);
 }
 
 wf::view_interface_t::view_interface_t() : surface_interface_t(nullptr)
@@ -862,7 +930,17 @@ void wf::view_interface_t::damage_box(const wlr_box& box)
     if (!get_output())
         return;
 
-    view_impl->offscreen_buffer.cached_damage |= box;
+    /* The damage of the snapshot is relative to its geometry. If there is
+     * no snapshot yet, the next one will be fully repainted anyway. */
+    auto& offscreen_buffer = view_impl->offscreen_buffer;
+    if (offscreen_buffer.valid())
+    {
+        offscreen_buffer.cached_damage |= wlr_box{
+            box.x - offscreen_buffer.geometry.x,
+            box.y - offscreen_buffer.geometry.y,
+            box.width, box.height};
+    }
+
     damage_raw(transform_region(box));
 }
 
@@ -900,7 +978,66 @@ void wf::view_interface_t::damage_raw(const wlr_box& box)
         get_output()->render->damage(damage_box);
     }
 
-    emit_signal("damaged-region", nullptr);
+    emit_signal(wf::signals::damaged_region, nullptr);
+}
+
+void wf::view_interface_t::damage_region(const wf_region& region)
+{
+    if (!get_output() || region.empty())
+        return;
+
+    auto& offscreen_buffer = view_impl->offscreen_buffer;
+    if (offscreen_buffer.valid())
+    {
+        offscreen_buffer.cached_damage |= region +
+            wf_point{-offscreen_buffer.geometry.x, -offscreen_buffer.geometry.y};
+    }
+
+    if (!view_impl->transforms.size())
+    {
+        damage_raw_region(region);
+        return;
+    }
+
+    /* Transformers can only transform boxes */
+    wf_region transformed;
+    for (const auto& rect : region)
+        transformed |= transform_region(wlr_box_from_pixman_box(rect));
+
+    damage_raw_region(transformed);
+}
+
+void wf::view_interface_t::damage_raw_region(const wf_region& region)
+{
+    if (!get_output() || region.empty())
+        return;
+
+    auto damage = get_output()->render->get_target_framebuffer().
+        damage_region_from_geometry_region(region);
+
+    /* Same as damage_raw(), shell views are damaged on all workspaces */
+    if (role == wf::VIEW_ROLE_SHELL_VIEW)
+    {
+        auto wsize = get_output()->workspace->get_workspace_grid_size();
+        auto cws = get_output()->workspace->get_current_workspace();
+
+        wlr_box ws_box = get_output()->render->get_damage_box();
+        wf_region visible_damage = damage & ws_box;
+
+        damage.clear();
+        for (int i = 0; i < wsize.width; i++)
+        {
+            for (int j = 0; j < wsize.height; j++)
+            {
+                const int dx = (i - cws.x) * ws_box.width;
+                const int dy = (j - cws.y) * ws_box.height;
+                damage |= visible_damage + wf_point{dx, dy};
+            }
+        }
+    }
+
+    get_output()->render->damage(damage);
+    emit_signal(wf::signals::damaged_region, nullptr);
 }
 
 void wf::view_interface_t::destruct()